@@ -1,4 +1,4 @@
-QT       += core gui
+QT       += core gui concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -8,22 +8,36 @@ CONFIG += c++17
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+include(spritecore.pri)
+
 SOURCES += \
+    animationclock.cpp \
     colorselection.cpp \
     drawingui.cpp \
+    fileworker.cpp \
+    frameview.cpp \
+    journal.cpp \
     main.cpp \
     mainwindow.cpp \
     model.cpp \
     spritepreview.cpp \
-    stampselection.cpp
+    stampselection.cpp \
+    tiledframe.cpp \
+    undohistory.cpp
 
 HEADERS += \
+    animationclock.h \
     colorselection.h \
     drawingui.h \
+    fileworker.h \
+    frameview.h \
+    journal.h \
     mainwindow.h \
     model.h \
     spritepreview.h \
-    stampselection.h
+    stampselection.h \
+    tiledframe.h \
+    undohistory.h
 
 FORMS += \
     colorselection.ui \
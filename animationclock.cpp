@@ -0,0 +1,175 @@
+/**
+ * @brief Keeps time for the animation previews so they
+ * all show the same frame and only run while visible.
+ */
+
+#include "animationclock.h"
+
+/**
+ * @brief AnimationClock::AnimationClock
+ * The clock is stopped until a viewer becomes visible
+ * @param parent
+ */
+AnimationClock::AnimationClock(QObject *parent)
+    : QObject{parent}
+{
+    timer.setSingleShot(true);
+    timer.setTimerType(Qt::PreciseTimer);
+    connect(&timer, &QTimer::timeout,
+            this, &AnimationClock::advance);
+}
+
+/**
+ * @brief AnimationClock::frameIndex
+ * @return
+ * The frame currently shown by the previews
+ */
+int AnimationClock::frameIndex() const
+{
+    return index;
+}
+
+/**
+ * @brief AnimationClock::frameDuration
+ * @param frame
+ * Position of the frame
+ * @return
+ * Milliseconds the frame is shown for, its own duration
+ * if it has one, otherwise the frame rate's
+ */
+int AnimationClock::frameDuration(int frame) const
+{
+    if(frame >= 0 && frame < static_cast<int>(durations.size()) && durations[frame] > 0){
+        return durations[frame];
+    }
+    return defaultDuration;
+}
+
+/**
+ * @brief AnimationClock::setFrameCount
+ * @param count
+ * Number of frames in the animation
+ */
+void AnimationClock::setFrameCount(int count)
+{
+    frameCount = qMax(1, count);
+    if(index >= frameCount){
+        index = 0;
+    }
+}
+
+/**
+ * @brief AnimationClock::setFrameRate
+ * @param fps
+ * Frames per second for frames without their own duration
+ */
+void AnimationClock::setFrameRate(int fps)
+{
+    int duration = 1000 / qMax(1, fps);
+    if(duration == defaultDuration){
+        return;
+    }
+    defaultDuration = duration;
+    //a slower rate waits for the current frame to end,
+    //a faster one should not wait the old duration out
+    if(timer.isActive() && frameEnd - elapsed.elapsed() > duration){
+        frameEnd = elapsed.elapsed() + duration;
+        scheduleNext();
+    }
+}
+
+/**
+ * @brief AnimationClock::setFrameDurations
+ * Sets the duration of every frame, which also sets the
+ * number of frames
+ * @param frameDurations
+ * Milliseconds per frame, 0 uses the frame rate
+ */
+void AnimationClock::setFrameDurations(const vector<int> &frameDurations)
+{
+    durations = frameDurations;
+    if(!durations.empty()){
+        setFrameCount(durations.size());
+    }
+}
+
+/**
+ * @brief AnimationClock::setViewerVisible
+ * Previews report when they are shown or hidden, the clock
+ * runs while at least one of them is visible
+ * @param visible
+ */
+void AnimationClock::setViewerVisible(bool visible)
+{
+    visibleViewers = qMax(0, visibleViewers + (visible ? 1 : -1));
+    if(visibleViewers > 0 && !timer.isActive()){
+        start();
+    }
+    else if(visibleViewers == 0){
+        timer.stop();
+    }
+}
+
+/**
+ * @brief AnimationClock::start
+ * Shows the current frame straight away and starts timing it
+ */
+void AnimationClock::start()
+{
+    elapsed.start();
+    frameEnd = frameDuration(index);
+    emit tick(index);
+    scheduleNext();
+}
+
+/**
+ * @brief AnimationClock::advance
+ * Moves to the frame that should be showing now. If ticks
+ * arrived late the frames whose time has passed are skipped,
+ * and after a long stall the schedule restarts from now
+ * instead of racing to catch up.
+ */
+void AnimationClock::advance()
+{
+    qint64 now = elapsed.elapsed();
+    if(now < frameEnd){
+        scheduleNext();
+        return;
+    }
+    qint64 late = now - frameEnd;
+    if(late > defaultDuration && late > loopDuration()){
+        index = (index + 1) % frameCount;
+        frameEnd = now + frameDuration(index);
+    }
+    else{
+        while(now >= frameEnd){
+            index = (index + 1) % frameCount;
+            frameEnd += frameDuration(index);
+        }
+    }
+    emit tick(index);
+    scheduleNext();
+}
+
+/**
+ * @brief AnimationClock::scheduleNext
+ * Waits until the current frame's deadline
+ */
+void AnimationClock::scheduleNext()
+{
+    timer.start(static_cast<int>(qMax<qint64>(0, frameEnd - elapsed.elapsed())));
+}
+
+/**
+ * @brief AnimationClock::loopDuration
+ * @return
+ * Milliseconds one pass through the animation takes
+ */
+qint64 AnimationClock::loopDuration() const
+{
+    qint64 total = 0;
+    for(int frame = 0; frame < frameCount; frame++){
+        total += frameDuration(frame);
+    }
+    return total;
+}
@@ -0,0 +1,53 @@
+#ifndef ANIMATIONCLOCK_H
+#define ANIMATIONCLOCK_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+#include <vector>
+
+using std::vector;
+
+/**
+ * Drives every animation preview from one schedule.
+ *
+ * Frame deadlines are measured from when playback started
+ * rather than from the previous tick, so late ticks do not
+ * add up. Frames can have their own durations, and the
+ * clock stops while no preview is visible.
+ */
+class AnimationClock : public QObject
+{
+    Q_OBJECT
+public:
+    explicit AnimationClock(QObject *parent = nullptr);
+
+    int frameIndex() const;
+    int frameDuration(int) const;
+
+public slots:
+    void setFrameCount(int);
+    void setFrameRate(int);
+    void setFrameDurations(const vector<int>&);
+    void setViewerVisible(bool);
+
+signals:
+    void tick(int);
+
+private:
+    QTimer timer;
+    QElapsedTimer elapsed;
+    qint64 frameEnd = 0;
+    int frameCount = 1;
+    int index = 0;
+    int defaultDuration = 100;
+    vector<int> durations;
+    int visibleViewers = 0;
+
+    void start();
+    void advance();
+    void scheduleNext();
+    qint64 loopDuration() const;
+};
+
+#endif // ANIMATIONCLOCK_H
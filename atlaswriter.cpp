@@ -0,0 +1,424 @@
+/**
+ * @brief Exports frames as a packed sprite sheet atlas with
+ * an index that game engines can load.
+ */
+
+#include "atlaswriter.h"
+#include <QDataStream>
+#include <QFileInfo>
+#include <QHash>
+#include <QImageWriter>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QtConcurrent>
+#include <QtMath>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+namespace {
+const char MAGIC[4] = {'S', 'S', 'P', 'A'};
+const quint16 VERSION = 1;
+
+bool samePixels(const QImage &first, const QRect &firstRect, const QImage &second, const QRect &secondRect)
+{
+    if(firstRect.size() != secondRect.size()){
+        return false;
+    }
+    const size_t rowBytes = firstRect.width() * sizeof(QRgb);
+    for(int y = 0; y < firstRect.height(); y++){
+        const uchar *a = first.constScanLine(firstRect.top() + y) + firstRect.left() * sizeof(QRgb);
+        const uchar *b = second.constScanLine(secondRect.top() + y) + secondRect.left() * sizeof(QRgb);
+        if(std::memcmp(a, b, rowBytes) != 0){
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+/**
+ * @brief AtlasWriter::write
+ * Packs the frames into an atlas png and writes its index.
+ * Frames are trimmed and hashed in parallel, copied into the
+ * atlas in parallel, and the png is compressed while the
+ * index is written.
+ * @param atlasFileName
+ * @param indexFileName
+ * @param frames
+ * @param durations
+ * Milliseconds per frame, stored in the index
+ * @param options
+ * @param error
+ * Set when the atlas is too large to be made
+ * @return
+ * true if both files were written
+ */
+bool AtlasWriter::write(const QString &atlasFileName, const QString &indexFileName,
+                        const vector<QImage> &frames, const vector<int> &durations, const Options &options,
+                        QString &error)
+{
+    if(frames.empty()){
+        return false;
+    }
+    const bool trim = options.trim;
+    const vector<Sprite> sprites = QtConcurrent::blockingMapped<vector<Sprite>>(frames,
+        [trim](const QImage &frame){
+            return prepareSprite(frame, trim);
+        });
+
+    //identical frames share the first one's rectangle
+    vector<int> uniqueIndex(sprites.size());
+    vector<int> uniqueSprites;
+    QHash<size_t, vector<int>> seen;
+    for(int frameIndex = 0; frameIndex < (int)sprites.size(); frameIndex++){
+        const Sprite &sprite = sprites[frameIndex];
+        int match = -1;
+        if(options.merge){
+            for(int candidate : seen.value(sprite.hash)){
+                const Sprite &other = sprites[uniqueSprites[candidate]];
+                if(samePixels(sprite.image, sprite.trimmed, other.image, other.trimmed)){
+                    match = candidate;
+                    break;
+                }
+            }
+        }
+        if(match < 0){
+            match = uniqueSprites.size();
+            uniqueSprites.push_back(frameIndex);
+            seen[sprite.hash].push_back(match);
+        }
+        uniqueIndex[frameIndex] = match;
+    }
+
+    vector<QRect> rects;
+    for(int frameIndex : uniqueSprites){
+        rects.push_back(QRect(QPoint(0, 0), sprites[frameIndex].trimmed.size()));
+    }
+    const int padding = qMax(0, options.padding);
+    const QSize atlasSize = options.packing == Grid ? packGrid(rects, padding)
+                                                     : packMaxRects(rects, padding);
+
+    //large sprites on a grid, or untrimmed, can ask for more
+    //than an image can hold or a texture can be
+    if(atlasSize.width() > MAX_ATLAS_SIDE || atlasSize.height() > MAX_ATLAS_SIDE){
+        error = QString("the atlas would be %1x%2, more than %3 pixels on a side")
+                .arg(atlasSize.width()).arg(atlasSize.height()).arg(MAX_ATLAS_SIDE);
+        return false;
+    }
+    QImage atlas(atlasSize.expandedTo(QSize(1, 1)), QImage::Format_ARGB32);
+    if(atlas.isNull()){
+        error = QString("not enough memory for a %1x%2 atlas").arg(atlasSize.width()).arg(atlasSize.height());
+        return false;
+    }
+    atlas.fill(Qt::transparent);
+    //every sprite has its own part of the atlas, so the rows can be
+    //copied from all threads through one pointer without detaching
+    uchar *atlasBits = atlas.bits();
+    const qsizetype atlasLine = atlas.bytesPerLine();
+    vector<int> order(uniqueSprites.size());
+    std::iota(order.begin(), order.end(), 0);
+    QtConcurrent::blockingMap(order, [&](int unique){
+        const Sprite &sprite = sprites[uniqueSprites[unique]];
+        const QRect &target = rects[unique];
+        const size_t rowBytes = target.width() * sizeof(QRgb);
+        for(int y = 0; y < target.height(); y++){
+            std::memcpy(atlasBits + (target.top() + y) * atlasLine + target.left() * sizeof(QRgb),
+                        sprite.image.constScanLine(sprite.trimmed.top() + y) + sprite.trimmed.left() * sizeof(QRgb),
+                        rowBytes);
+        }
+    });
+
+    vector<Placement> placements(frames.size());
+    for(int frameIndex = 0; frameIndex < (int)frames.size(); frameIndex++){
+        Placement &placement = placements[frameIndex];
+        placement.atlasRect = rects[uniqueIndex[frameIndex]];
+        placement.offset = sprites[frameIndex].trimmed.topLeft();
+        placement.frameSize = frames[frameIndex].size();
+        placement.duration = frameIndex < (int)durations.size() ? durations[frameIndex] : 0;
+    }
+
+    QFuture<bool> atlasSaved = QtConcurrent::run([&atlas, &atlasFileName](){
+        QSaveFile file(atlasFileName);
+        if(!file.open(QIODevice::WriteOnly)){
+            return false;
+        }
+        QImageWriter writer(&file, "png");
+        if(!writer.write(atlas)){
+            file.cancelWriting();
+            return false;
+        }
+        return file.commit();
+    });
+    bool indexSaved = options.indexFormat == JsonIndex
+            ? writeJsonIndex(indexFileName, QFileInfo(atlasFileName).fileName(), atlasSize, placements)
+            : writeBinaryIndex(indexFileName, atlasSize, placements);
+    return atlasSaved.result() && indexSaved;
+}
+
+/**
+ * @brief AtlasWriter::indexFileName
+ * @param atlasFileName
+ * @param format
+ * @return
+ * The index file that goes with an atlas, walk.png has walk.json
+ * or walk.atlas
+ */
+QString AtlasWriter::indexFileName(const QString &atlasFileName, IndexFormat format)
+{
+    QFileInfo info(atlasFileName);
+    return info.path() + "/" + info.completeBaseName() + (format == JsonIndex ? ".json" : ".atlas");
+}
+
+/**
+ * @brief AtlasWriter::prepareSprite
+ * Finds the part of the frame that goes into the atlas and
+ * hashes its pixels so duplicates can be found
+ * @param frame
+ * @param trim
+ * Whether fully transparent borders are cut off
+ * @return
+ * The sprite, a fully transparent frame trims to nothing
+ */
+AtlasWriter::Sprite AtlasWriter::prepareSprite(const QImage &frame, bool trim)
+{
+    Sprite sprite;
+    sprite.image = frame.convertToFormat(QImage::Format_ARGB32);
+    sprite.trimmed = sprite.image.rect();
+    if(trim){
+        int left = sprite.image.width();
+        int right = -1;
+        int top = sprite.image.height();
+        int bottom = -1;
+        for(int y = 0; y < sprite.image.height(); y++){
+            const QRgb *line = reinterpret_cast<const QRgb*>(sprite.image.constScanLine(y));
+            for(int x = 0; x < sprite.image.width(); x++){
+                if(qAlpha(line[x]) != 0){
+                    left = qMin(left, x);
+                    right = qMax(right, x);
+                    top = qMin(top, y);
+                    bottom = qMax(bottom, y);
+                }
+            }
+        }
+        sprite.trimmed = right < 0 ? QRect() : QRect(QPoint(left, top), QPoint(right, bottom));
+    }
+
+    size_t hash = qHash(sprite.trimmed.width()) ^ (qHash(sprite.trimmed.height()) << 1);
+    for(int y = 0; y < sprite.trimmed.height(); y++){
+        hash = qHashBits(sprite.image.constScanLine(sprite.trimmed.top() + y) + sprite.trimmed.left() * sizeof(QRgb),
+                         sprite.trimmed.width() * sizeof(QRgb), hash);
+    }
+    sprite.hash = hash;
+    return sprite;
+}
+
+/**
+ * @brief AtlasWriter::packGrid
+ * Places the rectangles in equal cells of a square-ish grid,
+ * the simplest layout for engines that index cells
+ * @param rects
+ * Sizes in, positions filled in
+ * @param padding
+ * Empty pixels between cells
+ * @return
+ * Size of the atlas
+ */
+QSize AtlasWriter::packGrid(vector<QRect> &rects, int padding)
+{
+    int cellWidth = 0;
+    int cellHeight = 0;
+    for(const QRect &rect : rects){
+        cellWidth = qMax(cellWidth, rect.width());
+        cellHeight = qMax(cellHeight, rect.height());
+    }
+    const int columns = qMax(1, qCeil(qSqrt(double(rects.size()))));
+    const int rows = (int(rects.size()) + columns - 1) / columns;
+    for(int index = 0; index < (int)rects.size(); index++){
+        rects[index].moveTo((index % columns) * (cellWidth + padding),
+                            (index / columns) * (cellHeight + padding));
+    }
+    return QSize(columns * (cellWidth + padding) - padding, rows * (cellHeight + padding) - padding);
+}
+
+/**
+ * @brief AtlasWriter::packMaxRects
+ * Packs the rectangles with MaxRects. The free space is kept as
+ * a list of maximal free rectangles, each sprite goes where its
+ * bottom edge ends highest, and the free rectangles it overlaps
+ * are split around it. Large sprites are placed first.
+ * @param rects
+ * Sizes in, positions filled in
+ * @param padding
+ * Empty pixels between sprites
+ * @return
+ * Size of the atlas
+ */
+QSize AtlasWriter::packMaxRects(vector<QRect> &rects, int padding)
+{
+    vector<int> order;
+    qint64 area = 0;
+    int widest = 0;
+    qint64 totalHeight = 0;
+    for(int index = 0; index < (int)rects.size(); index++){
+        const QRect &rect = rects[index];
+        if(rect.isEmpty()){
+            continue;
+        }
+        order.push_back(index);
+        area += qint64(rect.width() + padding) * (rect.height() + padding);
+        widest = qMax(widest, rect.width() + padding);
+        totalHeight += rect.height() + padding;
+    }
+    std::sort(order.begin(), order.end(), [&rects](int a, int b){
+        int sideA = qMax(rects[a].width(), rects[a].height());
+        int sideB = qMax(rects[b].width(), rects[b].height());
+        if(sideA != sideB){
+            return sideA > sideB;
+        }
+        return rects[a].width() * rects[a].height() > rects[b].width() * rects[b].height();
+    });
+
+    //a square bin that the sprites could fill, tall enough for any packing
+    const int binWidth = qMax(widest, qCeil(qSqrt(double(area))));
+    vector<QRect> freeRects = {QRect(0, 0, binWidth, int(qBound<qint64>(1, totalHeight, std::numeric_limits<int>::max())))};
+    int usedWidth = 0;
+    int usedHeight = 0;
+    for(int index : order){
+        const int width = rects[index].width() + padding;
+        const int height = rects[index].height() + padding;
+        int best = -1;
+        for(int f = 0; f < (int)freeRects.size(); f++){
+            const QRect &free = freeRects[f];
+            if(free.width() < width || free.height() < height){
+                continue;
+            }
+            if(best < 0 || free.y() < freeRects[best].y()
+                    || (free.y() == freeRects[best].y() && free.x() < freeRects[best].x())){
+                best = f;
+            }
+        }
+        //the bin is as tall as all sprites stacked, so one always fits
+        Q_ASSERT(best >= 0);
+        const QRect used(freeRects[best].topLeft(), QSize(width, height));
+        rects[index].moveTo(used.topLeft());
+        usedWidth = qMax(usedWidth, used.x() + width);
+        usedHeight = qMax(usedHeight, used.y() + height);
+
+        vector<QRect> split;
+        for(const QRect &free : freeRects){
+            if(!free.intersects(used)){
+                split.push_back(free);
+                continue;
+            }
+            if(used.x() > free.x()){
+                split.push_back(QRect(free.x(), free.y(), used.x() - free.x(), free.height()));
+            }
+            if(used.x() + width < free.x() + free.width()){
+                split.push_back(QRect(used.x() + width, free.y(),
+                                      free.x() + free.width() - used.x() - width, free.height()));
+            }
+            if(used.y() > free.y()){
+                split.push_back(QRect(free.x(), free.y(), free.width(), used.y() - free.y()));
+            }
+            if(used.y() + height < free.y() + free.height()){
+                split.push_back(QRect(free.x(), used.y() + height,
+                                      free.width(), free.y() + free.height() - used.y() - height));
+            }
+        }
+        //drop free rectangles inside other ones
+        freeRects.clear();
+        for(int a = 0; a < (int)split.size(); a++){
+            bool contained = false;
+            for(int b = 0; b < (int)split.size() && !contained; b++){
+                contained = a != b && split[b].contains(split[a])
+                        && (split[a] != split[b] || b < a);
+            }
+            if(!contained){
+                freeRects.push_back(split[a]);
+            }
+        }
+    }
+    return QSize(qMax(0, usedWidth - padding), qMax(0, usedHeight - padding));
+}
+
+/**
+ * @brief AtlasWriter::writeJsonIndex
+ * @param fileName
+ * @param atlasName
+ * File name of the atlas image, relative to the index
+ * @param atlasSize
+ * @param placements
+ * @return
+ * true if the index was written
+ */
+bool AtlasWriter::writeJsonIndex(const QString &fileName, const QString &atlasName,
+                                 QSize atlasSize, const vector<Placement> &placements)
+{
+    QJsonArray frames;
+    for(const Placement &placement : placements){
+        QJsonObject frame;
+        frame["x"] = placement.atlasRect.x();
+        frame["y"] = placement.atlasRect.y();
+        frame["width"] = placement.atlasRect.width();
+        frame["height"] = placement.atlasRect.height();
+        frame["offsetX"] = placement.offset.x();
+        frame["offsetY"] = placement.offset.y();
+        frame["frameWidth"] = placement.frameSize.width();
+        frame["frameHeight"] = placement.frameSize.height();
+        frame["duration"] = placement.duration;
+        frames.append(frame);
+    }
+    QJsonObject index;
+    index["image"] = atlasName;
+    index["width"] = atlasSize.width();
+    index["height"] = atlasSize.height();
+    index["frames"] = frames;
+
+    QSaveFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly)){
+        return false;
+    }
+    const QByteArray json = QJsonDocument(index).toJson(QJsonDocument::Indented);
+    if(file.write(json) != json.size()){
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+/**
+ * @brief AtlasWriter::writeBinaryIndex
+ * @param fileName
+ * @param atlasSize
+ * @param placements
+ * @return
+ * true if the index was written
+ */
+bool AtlasWriter::writeBinaryIndex(const QString &fileName, QSize atlasSize, const vector<Placement> &placements)
+{
+    QSaveFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly)){
+        return false;
+    }
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData(MAGIC, sizeof(MAGIC));
+    out << VERSION << quint16(0);
+    out << quint32(placements.size()) << quint32(atlasSize.width()) << quint32(atlasSize.height());
+    for(const Placement &placement : placements){
+        out << quint32(placement.atlasRect.x()) << quint32(placement.atlasRect.y())
+            << quint32(placement.atlasRect.width()) << quint32(placement.atlasRect.height())
+            << quint32(placement.offset.x()) << quint32(placement.offset.y())
+            << quint32(placement.frameSize.width()) << quint32(placement.frameSize.height())
+            << quint32(placement.duration);
+    }
+    if(out.status() != QDataStream::Ok){
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
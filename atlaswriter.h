@@ -0,0 +1,73 @@
+#ifndef ATLASWRITER_H
+#define ATLASWRITER_H
+
+#include <QImage>
+#include <QRect>
+#include <QString>
+#include <vector>
+
+using std::vector;
+
+/**
+ * Packs frames into one atlas image with an index of where
+ * each frame ended up.
+ *
+ * Frames can be trimmed to their visible pixels, identical
+ * frames are stored once and share an atlas rectangle, and the
+ * rectangles are packed either on a grid or with MaxRects.
+ * The index is JSON, or a little endian binary table:
+ *
+ * header  magic "SSPA", version, frame count, atlas width, height
+ * frames  one entry per frame: atlas x, y, width, height,
+ *         offset x, y inside the frame, frame width, height,
+ *         duration in milliseconds
+ */
+class AtlasWriter
+{
+public:
+    enum Packing {
+        Grid,
+        MaxRects
+    };
+
+    enum IndexFormat {
+        JsonIndex,
+        BinaryIndex
+    };
+
+    struct Options {
+        Packing packing = MaxRects;
+        IndexFormat indexFormat = JsonIndex;
+        bool trim = true;
+        bool merge = true;
+        int padding = 1;
+    };
+
+    struct Placement {
+        QRect atlasRect;
+        QPoint offset;
+        QSize frameSize;
+        int duration = 0;
+    };
+
+    static const int MAX_ATLAS_SIDE = 16384;
+
+    static bool write(const QString&, const QString&, const vector<QImage>&,
+                      const vector<int>&, const Options&, QString&);
+    static QString indexFileName(const QString&, IndexFormat);
+
+private:
+    struct Sprite {
+        QImage image;
+        QRect trimmed;
+        size_t hash = 0;
+    };
+
+    static Sprite prepareSprite(const QImage&, bool);
+    static QSize packGrid(vector<QRect>&, int);
+    static QSize packMaxRects(vector<QRect>&, int);
+    static bool writeJsonIndex(const QString&, const QString&, QSize, const vector<Placement>&);
+    static bool writeBinaryIndex(const QString&, QSize, const vector<Placement>&);
+};
+
+#endif // ATLASWRITER_H
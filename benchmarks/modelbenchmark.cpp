@@ -0,0 +1,413 @@
+/**
+ * @brief Benchmarks for the editing and file paths of the Model.
+ *
+ * Results can be written in a machine readable format with the
+ * usual Qt Test options, for example
+ *   ./modelbenchmark -o results.xml,xml
+ *   ./modelbenchmark -o results.csv,csv
+ * The *PeakMemory benchmarks report the growth of the peak
+ * resident set in bytes, they are skipped where the kernel
+ * cannot reset the peak (anything but Linux).
+ * Set SPRITE_BENCH_GIF to a GIF file to benchmark GIF import.
+ */
+
+#include "model.h"
+#include "binaryproject.h"
+#include "jsonproject.h"
+#include "spritefile.h"
+#include <QBuffer>
+#include <QFile>
+#include <QPainter>
+#include <QTemporaryDir>
+#include <QtTest>
+#include <functional>
+
+class ModelBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void fillPixel();
+    void stroke();
+    void resizeFrames_data();
+    void resizeFrames();
+    void addStamp();
+    void bucketFill_data();
+    void bucketFill();
+    void writeJson_data();
+    void writeJson();
+    void writeBinary_data();
+    void writeBinary();
+    void readJson_data();
+    void readJson();
+    void readBinary_data();
+    void readBinary();
+    void readJsonPeakMemory_data();
+    void readJsonPeakMemory();
+    void readBinaryPeakMemory_data();
+    void readBinaryPeakMemory();
+    void readGif();
+
+private:
+    QTemporaryDir tempDir;
+
+    static vector<QImage> syntheticFrames(int, int);
+    static void addProjectRows();
+    vector<QImage> projectFrames(const QString&);
+    QString writeProject(const QString&, SpriteFile::ProjectFormat);
+    static qint64 peakMemoryGrowth(const std::function<void()>&);
+};
+
+/**
+ * @brief ModelBenchmark::syntheticFrames
+ * Frames with a different gradient each so palettes and
+ * compression see realistic variety
+ * @param count
+ * Number of frames
+ * @param size
+ * Width and height of each frame
+ * @return
+ * The frames
+ */
+vector<QImage> ModelBenchmark::syntheticFrames(int count, int size)
+{
+    vector<QImage> frames;
+    for(int frameIndex = 0; frameIndex < count; frameIndex++){
+        QImage frame(size, size, QImage::Format_ARGB32);
+        for(int y = 0; y < size; y++){
+            QRgb *line = reinterpret_cast<QRgb*>(frame.scanLine(y));
+            for(int x = 0; x < size; x++){
+                line[x] = qRgba((x * 4 + frameIndex) & 0xff, (y * 4) & 0xff,
+                                (x + y + frameIndex) & 0xff, (x + y) % 3 == 0 ? 0 : 255);
+            }
+        }
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+/**
+ * @brief ModelBenchmark::addProjectRows
+ * The shipped example project and synthetic projects of growing length
+ */
+void ModelBenchmark::addProjectRows()
+{
+    QTest::addColumn<QString>("project");
+    QTest::newRow("rainbowAnimation") << "rainbow";
+    QTest::newRow("10 frames 64px") << "10";
+    QTest::newRow("100 frames 64px") << "100";
+    QTest::newRow("1000 frames 64px") << "1000";
+}
+
+/**
+ * @brief ModelBenchmark::projectFrames
+ * @param project
+ * A row of addProjectRows
+ * @return
+ * The frames of that project
+ */
+vector<QImage> ModelBenchmark::projectFrames(const QString &project)
+{
+    if(project == "rainbow"){
+        vector<QImage> frames;
+        QString error;
+        if(!SpriteFile::readProject(QString(SOURCE_DIR) + "/rainbowAnimation.ssp", frames, error)){
+            qWarning("%s", qPrintable(error));
+        }
+        return frames;
+    }
+    return syntheticFrames(project.toInt(), 64);
+}
+
+/**
+ * @brief ModelBenchmark::writeProject
+ * Writes a project to the temporary directory for the read benchmarks
+ * @param project
+ * A row of addProjectRows
+ * @param format
+ * @return
+ * Path of the written file
+ */
+QString ModelBenchmark::writeProject(const QString &project, SpriteFile::ProjectFormat format)
+{
+    QString path = tempDir.filePath(project + (format == SpriteFile::Binary ? ".bin.ssp" : ".json.ssp"));
+    if(!QFile::exists(path)){
+        QString error;
+        if(!SpriteFile::writeProject(path, projectFrames(project), vector<int>(), format, error)){
+            qWarning("%s", qPrintable(error));
+        }
+    }
+    return path;
+}
+
+/**
+ * @brief ModelBenchmark::peakMemoryGrowth
+ * Resets the kernel's record of the peak resident set, runs the
+ * work and reads how far the peak rose above where it started
+ * @param work
+ * @return
+ * Bytes, or -1 if the peak cannot be measured here
+ */
+qint64 ModelBenchmark::peakMemoryGrowth(const std::function<void()> &work)
+{
+#ifdef Q_OS_LINUX
+    auto readStatus = [](const QByteArray &field){
+        QFile status("/proc/self/status");
+        if(!status.open(QIODevice::ReadOnly | QIODevice::Text)){
+            return qint64(-1);
+        }
+        for(QByteArray line = status.readLine(); !line.isEmpty(); line = status.readLine()){
+            if(line.startsWith(field)){
+                return line.mid(field.size()).trimmed().split(' ').first().toLongLong() * 1024;
+            }
+        }
+        return qint64(-1);
+    };
+    QFile clearRefs("/proc/self/clear_refs");
+    if(!clearRefs.open(QIODevice::WriteOnly) || clearRefs.write("5") != 1){
+        return -1;
+    }
+    clearRefs.close();
+    qint64 before = readStatus("VmRSS:");
+    work();
+    qint64 peak = readStatus("VmHWM:");
+    if(before < 0 || peak < 0){
+        return -1;
+    }
+    return qMax<qint64>(0, peak - before);
+#else
+    Q_UNUSED(work);
+    return -1;
+#endif
+}
+
+void ModelBenchmark::fillPixel()
+{
+    Model model;
+    model.frames.at(0) = TiledFrame(SpriteFile::blankFrame(QSize(64, 64)));
+    model.spriteSize = QSize(64, 64);
+    QBENCHMARK {
+        for(int y = 0; y < 64; y++){
+            for(int x = 0; x < 64; x++){
+                model.fillPixel(0, x, y);
+            }
+        }
+    }
+}
+
+void ModelBenchmark::stroke()
+{
+    Model model;
+    model.setFrameSize(0);
+    QList<QPoint> points;
+    for(int i = 0; i < DEFAULT_WIDTH; i += 3){
+        points.append(QPoint(i / 8, (i * 7) % DEFAULT_WIDTH / 8));
+    }
+    QBENCHMARK {
+        model.beginStroke();
+        model.pointClicked(QPoint(0, 0));
+        model.pointsDragged(points);
+        model.endStroke();
+    }
+}
+
+void ModelBenchmark::resizeFrames_data()
+{
+    QTest::addColumn<int>("fromSize");
+    QTest::addColumn<int>("toSize");
+    QTest::newRow("100 frames to 64px") << 32 << 64;
+    QTest::newRow("100 frames to 32px") << 64 << 32;
+    QTest::newRow("100 frames to 16px") << 32 << 16;
+    QTest::newRow("100 frames to 8px") << 32 << 8;
+}
+
+void ModelBenchmark::resizeFrames()
+{
+    QFETCH(int, fromSize);
+    QFETCH(int, toSize);
+    const vector<TiledFrame> source = TiledFrame::fromImages(syntheticFrames(100, fromSize));
+    Model model;
+    QBENCHMARK {
+        model.frames = source;
+        model.spriteSize = QSize(fromSize, fromSize);
+        model.resizeFrames(QSize(toSize, toSize));
+    }
+}
+
+void ModelBenchmark::addStamp()
+{
+    Model model;
+    model.setFrameSize(0);
+    QImage stamp(128, 128, QImage::Format_ARGB32);
+    stamp.fill(Qt::transparent);
+    QPainter painter(&stamp);
+    painter.setBrush(Qt::red);
+    painter.drawEllipse(stamp.rect());
+    painter.end();
+    int step = 0;
+    QBENCHMARK {
+        model.addStamp(stamp, QPoint((step * 37) % 64, (step * 53) % 64));
+        step++;
+    }
+}
+
+void ModelBenchmark::bucketFill_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::addColumn<int>("frameCount");
+    QTest::addColumn<bool>("global");
+    QTest::addColumn<bool>("allFrames");
+    QTest::newRow("contiguous 2048px") << 2048 << 1 << false << false;
+    QTest::newRow("everywhere 2048px") << 2048 << 1 << true << false;
+    QTest::newRow("contiguous 16 frames 512px") << 512 << 16 << false << true;
+}
+
+void ModelBenchmark::bucketFill()
+{
+    QFETCH(int, size);
+    QFETCH(int, frameCount);
+    QFETCH(bool, global);
+    QFETCH(bool, allFrames);
+    //crossing lines split the frame into many irregular areas
+    QImage frame = SpriteFile::blankFrame(QSize(size, size));
+    QPainter painter(&frame);
+    painter.setPen(Qt::black);
+    for(int i = 0; i < size; i += 37){
+        painter.drawLine(i, 0, size - 1 - i / 2, size - 1);
+        painter.drawLine(0, i, size - 1, (i * 3) % size);
+    }
+    painter.end();
+
+    Model model;
+    model.frames.assign(frameCount, TiledFrame(frame));
+    model.frameDurations.assign(frameCount, 0);
+    model.spriteSize = frame.size();
+    model.setBucketActive(true);
+    model.setBucketGlobal(global);
+    model.setBucketAllFrames(allFrames);
+    int step = 0;
+    QBENCHMARK {
+        model.setColor(step % 2 == 0 ? QColor(Qt::red) : QColor(Qt::blue));
+        model.pointClicked(QPoint(size / 2, size / 3));
+        step++;
+    }
+}
+
+void ModelBenchmark::writeJson_data()
+{
+    addProjectRows();
+}
+
+void ModelBenchmark::writeJson()
+{
+    QFETCH(QString, project);
+    const vector<QImage> frames = projectFrames(project);
+    QBENCHMARK {
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+        JsonProject::write(&buffer, frames, false);
+    }
+}
+
+void ModelBenchmark::writeBinary_data()
+{
+    addProjectRows();
+}
+
+void ModelBenchmark::writeBinary()
+{
+    QFETCH(QString, project);
+    const vector<QImage> frames = projectFrames(project);
+    const QString path = tempDir.filePath("write.ssp");
+    QBENCHMARK {
+        BinaryProject::write(path, frames);
+    }
+}
+
+void ModelBenchmark::readJson_data()
+{
+    addProjectRows();
+}
+
+void ModelBenchmark::readJson()
+{
+    QFETCH(QString, project);
+    const QString path = writeProject(project, SpriteFile::Json);
+    QBENCHMARK {
+        vector<QImage> frames;
+        QString error;
+        QVERIFY(SpriteFile::readProject(path, frames, error));
+    }
+}
+
+void ModelBenchmark::readBinary_data()
+{
+    addProjectRows();
+}
+
+void ModelBenchmark::readBinary()
+{
+    QFETCH(QString, project);
+    const QString path = writeProject(project, SpriteFile::Binary);
+    QBENCHMARK {
+        vector<QImage> frames;
+        QString error;
+        QVERIFY(SpriteFile::readProject(path, frames, error));
+    }
+}
+
+void ModelBenchmark::readJsonPeakMemory_data()
+{
+    addProjectRows();
+}
+
+void ModelBenchmark::readJsonPeakMemory()
+{
+    QFETCH(QString, project);
+    const QString path = writeProject(project, SpriteFile::Json);
+    qint64 growth = peakMemoryGrowth([&path](){
+        vector<QImage> frames;
+        QString error;
+        SpriteFile::readProject(path, frames, error);
+    });
+    if(growth < 0){
+        QSKIP("Peak memory cannot be measured on this system");
+    }
+    QTest::setBenchmarkResult(growth, QTest::BytesAllocated);
+}
+
+void ModelBenchmark::readBinaryPeakMemory_data()
+{
+    addProjectRows();
+}
+
+void ModelBenchmark::readBinaryPeakMemory()
+{
+    QFETCH(QString, project);
+    const QString path = writeProject(project, SpriteFile::Binary);
+    qint64 growth = peakMemoryGrowth([&path](){
+        vector<QImage> frames;
+        QString error;
+        SpriteFile::readProject(path, frames, error);
+    });
+    if(growth < 0){
+        QSKIP("Peak memory cannot be measured on this system");
+    }
+    QTest::setBenchmarkResult(growth, QTest::BytesAllocated);
+}
+
+void ModelBenchmark::readGif()
+{
+    const QString path = qEnvironmentVariable("SPRITE_BENCH_GIF");
+    if(path.isEmpty()){
+        QSKIP("Set SPRITE_BENCH_GIF to a GIF file to benchmark GIF import");
+    }
+    QBENCHMARK {
+        vector<QImage> frames;
+        QString error;
+        QVERIFY(SpriteFile::readGif(path, QSize(64, 64), frames, error));
+    }
+}
+
+QTEST_MAIN(ModelBenchmark)
+#include "modelbenchmark.moc"
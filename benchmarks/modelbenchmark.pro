@@ -0,0 +1,29 @@
+# Benchmarks for the Model's editing and file paths:
+#   qmake modelbenchmark.pro && make
+#   ./modelbenchmark -o results.xml,xml
+
+QT       += testlib widgets
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = modelbenchmark
+
+include(../spritecore.pri)
+
+DEFINES += SOURCE_DIR=\\\"$$PWD/..\\\"
+
+SOURCES += \
+    modelbenchmark.cpp \
+    ../fileworker.cpp \
+    ../journal.cpp \
+    ../model.cpp \
+    ../tiledframe.cpp \
+    ../undohistory.cpp
+
+HEADERS += \
+    ../fileworker.h \
+    ../journal.h \
+    ../model.h \
+    ../tiledframe.h \
+    ../undohistory.h
@@ -0,0 +1,693 @@
+/**
+ * @brief Reads and writes the binary .ssp project format.
+ * Frames are stored as raw pixel blocks behind a frame offset
+ * table so the file can be mapped and decoded one frame at a time.
+ * Projects with 256 colors or fewer are written as palette indices.
+ * Frames that are mostly transparent only store the tiles that
+ * have something drawn on them.
+ */
+
+#include "binaryproject.h"
+#include <QDataStream>
+#include <QHash>
+#include <QSet>
+#include <QSaveFile>
+#include <QThread>
+#include <QtConcurrent>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace {
+const char MAGIC[4] = {'S', 'S', 'P', 'B'};
+const quint16 VERSION = 3;
+const quint16 SPARSE_VERSION = 2;
+const quint16 DENSE_VERSION = 1;
+const int DURATION_ENTRY_SIZE = 4;
+const int SPARSE_TILE_SIZE = 32;
+const int SPARSE_HEADER_SIZE = 8;
+const QRgb TRANSPARENT_PIXEL = qRgba(255, 255, 255, 0);
+const quint16 HEADER_SIZE = 32;
+const int FRAME_ENTRY_SIZE = 16;
+const quint32 MAX_SIDE = 1 << 15;
+const quint32 MAX_PALETTE_SIZE = 256;
+
+struct EncodedBlock {
+    QByteArray pixels;
+    quint32 encoding = 0;
+};
+}
+
+/**
+ * @brief BinaryProject::BinaryProject
+ * Creates a reader with no file open
+ */
+BinaryProject::BinaryProject()
+{
+
+}
+
+/**
+ * @brief BinaryProject::~BinaryProject
+ * Unmaps and closes the project file
+ */
+BinaryProject::~BinaryProject()
+{
+    close();
+}
+
+/**
+ * @brief BinaryProject::isBinaryProject
+ * Checks the magic bytes so legacy JSON projects that share
+ * the .ssp extension can be told apart
+ * @param fileName
+ * @return
+ * true when the file starts with the binary project magic
+ */
+bool BinaryProject::isBinaryProject(const QString &fileName)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly)){
+        return false;
+    }
+    char magic[sizeof(MAGIC)];
+    return file.read(magic, sizeof(MAGIC)) == sizeof(MAGIC)
+            && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+/**
+ * @brief BinaryProject::collectPalette
+ * Gathers the distinct colors used by all frames
+ * @param frames
+ * @return
+ * The colors in order of first use, or an empty palette
+ * when the project uses more than 256 colors
+ */
+vector<QRgb> BinaryProject::collectPalette(const vector<QImage> &frames)
+{
+    //each frame's colors are gathered in parallel and merged in frame
+    //order, so the palette is the same whatever the thread count
+    const vector<vector<QRgb>> frameColors =
+            QtConcurrent::blockingMapped<vector<vector<QRgb>>>(frames, &BinaryProject::collectColors);
+
+    vector<QRgb> palette;
+    QSet<QRgb> seen;
+    for(const vector<QRgb> &colors : frameColors){
+        for(QRgb color : colors){
+            if(seen.contains(color)){
+                continue;
+            }
+            if(palette.size() == MAX_PALETTE_SIZE){
+                return vector<QRgb>();
+            }
+            seen.insert(color);
+            palette.push_back(color);
+        }
+    }
+    return palette;
+}
+
+/**
+ * @brief BinaryProject::collectColors
+ * Gathers the distinct colors of one frame, stopping once
+ * there are more than a palette can hold
+ * @param frame
+ * @return
+ * The colors in order of first use
+ */
+vector<QRgb> BinaryProject::collectColors(const QImage &frame)
+{
+    vector<QRgb> colors;
+    QSet<QRgb> seen;
+    const QImage image = frame.convertToFormat(QImage::Format_ARGB32);
+    for(int y = 0; y < image.height(); y++){
+        const QRgb *line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+        for(int x = 0; x < image.width(); x++){
+            if(seen.contains(line[x])){
+                continue;
+            }
+            seen.insert(line[x]);
+            colors.push_back(line[x]);
+            if(colors.size() > MAX_PALETTE_SIZE){
+                return colors;
+            }
+        }
+    }
+    return colors;
+}
+
+/**
+ * @brief BinaryProject::projectPalette
+ * @param frames
+ * @return
+ * The palette all frames share if they are indexed images with
+ * the same color table, otherwise an empty palette
+ */
+QList<QRgb> BinaryProject::projectPalette(const vector<QImage> &frames)
+{
+    const QList<QRgb> palette = frames.at(0).colorTable();
+    if(palette.isEmpty() || palette.size() > qsizetype(MAX_PALETTE_SIZE)){
+        return QList<QRgb>();
+    }
+    for(const QImage &frame : frames){
+        if(frame.format() != QImage::Format_Indexed8 || frame.colorTable() != palette){
+            return QList<QRgb>();
+        }
+    }
+    return palette;
+}
+
+/**
+ * @brief BinaryProject::encodeFrame
+ * Converts one frame into its pixel block
+ * @param frame
+ * @param paletteIndex
+ * Palette index of every color, or nullptr to store raw ARGB
+ * @return
+ * The block as it is stored in the file
+ */
+QByteArray BinaryProject::encodeFrame(const QImage &frame, const QHash<QRgb, uchar> *paletteIndex)
+{
+    const QImage image = frame.convertToFormat(QImage::Format_ARGB32);
+    const int width = image.width();
+    const int height = image.height();
+    QByteArray block(width * height * (paletteIndex ? 1 : 4), Qt::Uninitialized);
+    uchar *dest = reinterpret_cast<uchar*>(block.data());
+    for(int y = 0; y < height; y++){
+        const QRgb *line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+        if(paletteIndex){
+            for(int x = 0; x < width; x++){
+                *dest++ = paletteIndex->value(line[x]);
+            }
+        }
+        else{
+            qToLittleEndian<quint32>(line, width, dest);
+            dest += width * 4;
+        }
+    }
+    return block;
+}
+
+/**
+ * @brief BinaryProject::encodeIndices
+ * Copies the index rows of an indexed frame, dropping the
+ * padding at the end of each scanline
+ * @param frame
+ * An indexed image
+ * @return
+ * The block as it is stored in the file
+ */
+QByteArray BinaryProject::encodeIndices(const QImage &frame)
+{
+    const int width = frame.width();
+    QByteArray block(width * frame.height(), Qt::Uninitialized);
+    for(int y = 0; y < frame.height(); y++){
+        std::memcpy(block.data() + y * width, frame.constScanLine(y), width);
+    }
+    return block;
+}
+
+/**
+ * @brief BinaryProject::sparseTiles
+ * Stores a pixel block as tiles, leaving out the tiles where
+ * every pixel is the fill value
+ * @param dense
+ * The block as rows of pixels
+ * @param width
+ * @param height
+ * @param bytesPerPixel
+ * 4 for ARGB, 1 for palette indices
+ * @param fill
+ * The pixel value of empty tiles
+ * @return
+ * The sparse block, or an empty array if it would not be
+ * smaller than the dense one
+ */
+QByteArray BinaryProject::sparseTiles(const QByteArray &dense, int width, int height,
+                                      int bytesPerPixel, quint32 fill)
+{
+    uchar fillBytes[4];
+    qToLittleEndian<quint32>(fill, fillBytes);
+    const int tilesX = (width + SPARSE_TILE_SIZE - 1) / SPARSE_TILE_SIZE;
+    const int tilesY = (height + SPARSE_TILE_SIZE - 1) / SPARSE_TILE_SIZE;
+    const int maskBytes = (tilesX * tilesY + 7) / 8;
+    const qsizetype rowBytes = qsizetype(width) * bytesPerPixel;
+    const uchar *pixels = reinterpret_cast<const uchar*>(dense.constData());
+
+    QByteArray block(SPARSE_HEADER_SIZE + maskBytes, 0);
+    qToLittleEndian<quint32>(SPARSE_TILE_SIZE, block.data());
+    qToLittleEndian<quint32>(fill, block.data() + 4);
+    for(int tileY = 0; tileY < tilesY; tileY++){
+        const int top = tileY * SPARSE_TILE_SIZE;
+        const int rows = qMin(SPARSE_TILE_SIZE, height - top);
+        for(int tileX = 0; tileX < tilesX; tileX++){
+            const int left = tileX * SPARSE_TILE_SIZE;
+            const qsizetype tileRowBytes = qsizetype(qMin(SPARSE_TILE_SIZE, width - left)) * bytesPerPixel;
+            bool empty = true;
+            for(int y = 0; y < rows && empty; y++){
+                const uchar *row = pixels + (top + y) * rowBytes + left * bytesPerPixel;
+                for(qsizetype byte = 0; byte < tileRowBytes; byte++){
+                    if(row[byte] != fillBytes[byte % bytesPerPixel]){
+                        empty = false;
+                        break;
+                    }
+                }
+            }
+            if(empty){
+                continue;
+            }
+            const int tile = tileY * tilesX + tileX;
+            block[SPARSE_HEADER_SIZE + tile / 8] = char(block[SPARSE_HEADER_SIZE + tile / 8] | (1 << (tile % 8)));
+            for(int y = 0; y < rows; y++){
+                block.append(reinterpret_cast<const char*>(pixels + (top + y) * rowBytes + left * bytesPerPixel),
+                             tileRowBytes);
+            }
+            if(block.size() >= dense.size()){
+                return QByteArray();
+            }
+        }
+    }
+    return block;
+}
+
+/**
+ * @brief BinaryProject::expandTiles
+ * Rebuilds the rows of pixels of a sparse block
+ * @param block
+ * @param size
+ * Bytes in the block
+ * @param width
+ * @param height
+ * @param bytesPerPixel
+ * @param dense
+ * Set to the rows of pixels
+ * @return
+ * false if the block is damaged
+ */
+bool BinaryProject::expandTiles(const uchar *block, quint32 size, int width, int height,
+                                int bytesPerPixel, QByteArray &dense)
+{
+    if(size < SPARSE_HEADER_SIZE){
+        return false;
+    }
+    const int tileSize = int(qFromLittleEndian<quint32>(block));
+    if(tileSize <= 0 || quint32(tileSize) > MAX_SIDE){
+        return false;
+    }
+    uchar fillBytes[4];
+    std::memcpy(fillBytes, block + 4, 4);
+    const int tilesX = (width + tileSize - 1) / tileSize;
+    const int tilesY = (height + tileSize - 1) / tileSize;
+    const qint64 maskBytes = (qint64(tilesX) * tilesY + 7) / 8;
+    if(SPARSE_HEADER_SIZE + maskBytes > size){
+        return false;
+    }
+    const uchar *mask = block + SPARSE_HEADER_SIZE;
+    const uchar *tilePixels = mask + maskBytes;
+    const uchar *end = block + size;
+    const qsizetype rowBytes = qsizetype(width) * bytesPerPixel;
+
+    dense.resize(rowBytes * height);
+    uchar *pixels = reinterpret_cast<uchar*>(dense.data());
+    for(qsizetype byte = 0; byte < dense.size(); byte++){
+        pixels[byte] = fillBytes[byte % bytesPerPixel];
+    }
+    for(int tileY = 0; tileY < tilesY; tileY++){
+        const int top = tileY * tileSize;
+        const int rows = qMin(tileSize, height - top);
+        for(int tileX = 0; tileX < tilesX; tileX++){
+            const int tile = tileY * tilesX + tileX;
+            if(!(mask[tile / 8] & (1 << (tile % 8)))){
+                continue;
+            }
+            const int left = tileX * tileSize;
+            const qsizetype tileRowBytes = qsizetype(qMin(tileSize, width - left)) * bytesPerPixel;
+            if(end - tilePixels < tileRowBytes * rows){
+                return false;
+            }
+            for(int y = 0; y < rows; y++){
+                std::memcpy(pixels + (top + y) * rowBytes + left * bytesPerPixel, tilePixels, tileRowBytes);
+                tilePixels += tileRowBytes;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief BinaryProject::write
+ * Writes the frames as a binary project. The file is replaced
+ * atomically so a failed save never leaves a partial project.
+ * @param fileName
+ * @param frames
+ * Frames of the project, all the same size
+ * @param durations
+ * Milliseconds each frame is shown for, missing entries are 0.
+ * Without any timing the durations are left out of the file.
+ * @return
+ * true if the project was written
+ */
+bool BinaryProject::write(const QString &fileName, const vector<QImage> &frames, const vector<int> &durations)
+{
+    if(frames.empty()){
+        return false;
+    }
+    const int width = frames.at(0).width();
+    const int height = frames.at(0).height();
+    //indexed frames keep their palette and indices as they are,
+    //other frames are indexed on disk if they use few colors
+    const QList<QRgb> sharedPalette = projectPalette(frames);
+    const bool indexedFrames = !sharedPalette.isEmpty();
+    const vector<QRgb> palette = indexedFrames
+            ? vector<QRgb>(sharedPalette.begin(), sharedPalette.end()) : collectPalette(frames);
+    const bool indexed = !palette.empty();
+
+    QHash<QRgb, uchar> paletteIndex;
+    for(size_t index = 0; index < palette.size(); index++){
+        paletteIndex.insert(palette[index], static_cast<uchar>(index));
+    }
+
+    //frames sharing pixels in memory share one block in the file
+    vector<QImage> blockFrames;
+    vector<int> frameBlocks;
+    QHash<qint64, int> blockIndex;
+    for(const QImage &frame : frames){
+        auto block = blockIndex.constFind(frame.cacheKey());
+        if(block == blockIndex.cend()){
+            block = blockIndex.insert(frame.cacheKey(), blockFrames.size());
+            blockFrames.push_back(frame);
+        }
+        frameBlocks.push_back(*block);
+    }
+
+    //mostly transparent frames are stored as tiles, which needs
+    //a value for the transparent pixel in the block's encoding
+    const auto transparentIndex = paletteIndex.constFind(TRANSPARENT_PIXEL);
+    const bool sparseIndices = transparentIndex != paletteIndex.cend();
+    const quint32 indexFill = sparseIndices ? *transparentIndex : 0;
+    const quint64 tableOffset = HEADER_SIZE + palette.size() * 4;
+    const bool timed = std::any_of(durations.begin(), durations.end(), [](int duration){ return duration > 0; });
+    quint32 flags = indexedFrames ? IndexedProject : 0;
+    if(timed){
+        flags |= FrameDurations;
+    }
+
+    QSaveFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly)){
+        return false;
+    }
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+
+    out.writeRawData(MAGIC, sizeof(MAGIC));
+    out << DENSE_VERSION << HEADER_SIZE;
+    out << quint32(width) << quint32(height) << quint32(frames.size());
+    out << quint32(palette.size()) << flags << quint32(0);
+    for(QRgb color : palette){
+        out << quint32(color);
+    }
+    //block sizes are only known once the frames are encoded, so
+    //the frame table is filled in after the blocks are written
+    out.writeRawData(QByteArray(frames.size() * FRAME_ENTRY_SIZE, 0).constData(),
+                     frames.size() * FRAME_ENTRY_SIZE);
+    if(timed){
+        for(size_t frame = 0; frame < frames.size(); frame++){
+            out << quint32(frame < durations.size() ? qMax(0, durations[frame]) : 0);
+        }
+    }
+
+    //encode a batch of frames at a time in parallel, then write them in order
+    auto encode = [&](const QImage &frame){
+        EncodedBlock block;
+        block.pixels = indexedFrames ? encodeIndices(frame)
+                                     : encodeFrame(frame, indexed ? &paletteIndex : nullptr);
+        block.encoding = indexed ? PaletteIndex : RawArgb;
+        if(indexed && !sparseIndices){
+            return block;
+        }
+        QByteArray tiles = sparseTiles(block.pixels, width, height, indexed ? 1 : 4,
+                                       indexed ? indexFill : TRANSPARENT_PIXEL);
+        if(!tiles.isEmpty()){
+            block.pixels = tiles;
+            block.encoding = indexed ? SparseIndex : SparseArgb;
+        }
+        return block;
+    };
+    vector<quint64> blockOffsets;
+    vector<quint32> blockSizes;
+    vector<quint32> blockEncodings;
+    bool sparse = false;
+    quint64 offset = tableOffset + frames.size() * FRAME_ENTRY_SIZE
+            + (timed ? frames.size() * DURATION_ENTRY_SIZE : 0);
+    const size_t batchSize = qMax(1, QThread::idealThreadCount()) * 4;
+    for(size_t first = 0; first < blockFrames.size(); first += batchSize){
+        const vector<QImage> batch(blockFrames.begin() + first,
+                                   blockFrames.begin() + qMin(blockFrames.size(), first + batchSize));
+        const vector<EncodedBlock> blocks = QtConcurrent::blockingMapped<vector<EncodedBlock>>(batch, encode);
+        for(const EncodedBlock &block : blocks){
+            out.writeRawData(block.pixels.constData(), block.pixels.size());
+            blockOffsets.push_back(offset);
+            blockSizes.push_back(block.pixels.size());
+            blockEncodings.push_back(block.encoding);
+            sparse = sparse || block.encoding == SparseArgb || block.encoding == SparseIndex;
+            offset += block.pixels.size();
+        }
+    }
+
+    if(!file.seek(tableOffset)){
+        file.cancelWriting();
+        return false;
+    }
+    for(int block : frameBlocks){
+        out << blockOffsets[block] << blockSizes[block] << blockEncodings[block];
+    }
+    //files without timing or sparse frames stay readable by older editors
+    const quint16 version = timed ? VERSION : sparse ? SPARSE_VERSION : DENSE_VERSION;
+    if(version != DENSE_VERSION){
+        if(!file.seek(sizeof(MAGIC))){
+            file.cancelWriting();
+            return false;
+        }
+        out << version;
+    }
+
+    if(out.status() != QDataStream::Ok){
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+/**
+ * @brief BinaryProject::open
+ * Maps the project file and reads the header, palette and
+ * frame table. Frame pixels are only touched by frame().
+ * @param fileName
+ * @return
+ * true if the file is a readable binary project
+ */
+bool BinaryProject::open(const QString &fileName)
+{
+    close();
+    file.setFileName(fileName);
+    if(!file.open(QIODevice::ReadOnly)){
+        return fail(file.errorString());
+    }
+    dataSize = file.size();
+    data = file.map(0, dataSize);
+    if(data == nullptr){
+        return fail("Unable to map the project file");
+    }
+    if(dataSize < HEADER_SIZE || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0){
+        return fail("Not a binary sprite project");
+    }
+
+    quint16 version = qFromLittleEndian<quint16>(data + 4);
+    quint16 headerSize = qFromLittleEndian<quint16>(data + 6);
+    quint32 width = qFromLittleEndian<quint32>(data + 8);
+    quint32 height = qFromLittleEndian<quint32>(data + 12);
+    quint32 frames = qFromLittleEndian<quint32>(data + 16);
+    quint32 paletteSize = qFromLittleEndian<quint32>(data + 20);
+    quint32 flags = qFromLittleEndian<quint32>(data + 24);
+
+    if(version > VERSION){
+        return fail("Project was saved by a newer version of the editor");
+    }
+    if(headerSize < HEADER_SIZE || width == 0 || height == 0 || frames == 0
+            || width > MAX_SIDE || height > MAX_SIDE || paletteSize > MAX_PALETTE_SIZE){
+        return fail("Project header is corrupt");
+    }
+
+    quint64 tableOffset = headerSize + quint64(paletteSize) * 4;
+    quint64 durationsOffset = tableOffset + quint64(frames) * FRAME_ENTRY_SIZE;
+    const bool timed = version >= VERSION && (flags & FrameDurations);
+    if(durationsOffset + (timed ? quint64(frames) * DURATION_ENTRY_SIZE : 0) > quint64(dataSize)){
+        return fail("Project file is truncated");
+    }
+
+    palette.resize(paletteSize);
+    for(quint32 index = 0; index < paletteSize; index++){
+        palette[index] = qFromLittleEndian<quint32>(data + headerSize + index * 4);
+    }
+    //projects saved without timing show every frame for 0 ms
+    durations.assign(frames, 0);
+    if(timed){
+        for(quint32 frame = 0; frame < frames; frame++){
+            const uchar *entry = data + durationsOffset + quint64(frame) * DURATION_ENTRY_SIZE;
+            const quint32 duration = qFromLittleEndian<quint32>(entry);
+            durations[frame] = int(qMin<quint32>(duration, std::numeric_limits<int>::max()));
+        }
+    }
+    indexedProject = (flags & IndexedProject) && paletteSize > 0;
+    frameTable = data + tableOffset;
+    frameWidth = width;
+    frameHeight = height;
+    numberOfFrames = frames;
+    return true;
+}
+
+/**
+ * @brief BinaryProject::close
+ * Releases the mapping and the file
+ */
+void BinaryProject::close()
+{
+    if(data != nullptr){
+        file.unmap(data);
+        data = nullptr;
+    }
+    file.close();
+    dataSize = 0;
+    frameWidth = 0;
+    frameHeight = 0;
+    numberOfFrames = 0;
+    palette.clear();
+    durations.clear();
+    indexedProject = false;
+    frameTable = nullptr;
+}
+
+/**
+ * @brief BinaryProject::fail
+ * Records the error and releases the file
+ * @param message
+ * @return
+ * always false so callers can return it directly
+ */
+bool BinaryProject::fail(const QString &message)
+{
+    close();
+    error = message;
+    return false;
+}
+
+int BinaryProject::width() const
+{
+    return frameWidth;
+}
+
+int BinaryProject::height() const
+{
+    return frameHeight;
+}
+
+int BinaryProject::frameCount() const
+{
+    return numberOfFrames;
+}
+
+vector<int> BinaryProject::frameDurations() const
+{
+    return durations;
+}
+
+QString BinaryProject::errorString() const
+{
+    return error;
+}
+
+/**
+ * @brief BinaryProject::frame
+ * Decodes one frame straight from the mapped file
+ * @param index
+ * index of the frame in the project
+ * @return
+ * The frame as an ARGB32 image, or an indexed image for indexed
+ * projects, or a null image if the frame block is damaged
+ */
+QImage BinaryProject::frame(int index) const
+{
+    if(index < 0 || index >= numberOfFrames){
+        return QImage();
+    }
+    const uchar *entry = frameTable + index * FRAME_ENTRY_SIZE;
+    quint64 offset = qFromLittleEndian<quint64>(entry);
+    quint32 size = qFromLittleEndian<quint32>(entry + 8);
+    quint32 encoding = qFromLittleEndian<quint32>(entry + 12);
+    if(offset > quint64(dataSize) || size > quint64(dataSize) - offset){
+        return QImage();
+    }
+
+    //open() accepts sides the int size math would overflow on,
+    //so sizes are worked out in 64 bits before anything is allocated
+    const quint64 pixelCount = quint64(frameWidth) * quint64(frameHeight);
+    const uchar *block = data + offset;
+    //sparse blocks are expanded to the rows of a dense block
+    QByteArray expanded;
+    if(encoding == SparseArgb || encoding == SparseIndex){
+        const int bytesPerPixel = encoding == SparseArgb ? 4 : 1;
+        //a dense block's size has to fit the frame table's size field
+        if(pixelCount * bytesPerPixel > std::numeric_limits<quint32>::max()){
+            return QImage();
+        }
+        if(!expandTiles(block, size, frameWidth, frameHeight, bytesPerPixel, expanded)){
+            return QImage();
+        }
+        block = reinterpret_cast<const uchar*>(expanded.constData());
+        size = expanded.size();
+        encoding = encoding == SparseArgb ? RawArgb : PaletteIndex;
+    }
+    if(indexedProject && encoding == PaletteIndex && size == pixelCount){
+        QImage image(frameWidth, frameHeight, QImage::Format_Indexed8);
+        if(image.isNull()){
+            return QImage();
+        }
+        for(int y = 0; y < frameHeight; y++){
+            const uchar *indices = block + qsizetype(y) * frameWidth;
+            for(int x = 0; x < frameWidth; x++){
+                if(indices[x] >= palette.size()){
+                    return QImage();
+                }
+            }
+            std::memcpy(image.scanLine(y), indices, frameWidth);
+        }
+        image.setColorTable(palette);
+        return image;
+    }
+
+    const bool rawArgb = encoding == RawArgb && size == pixelCount * 4;
+    const bool paletteIndex = encoding == PaletteIndex && size == pixelCount;
+    if(!rawArgb && !paletteIndex){
+        return QImage();
+    }
+    QImage image(frameWidth, frameHeight, QImage::Format_ARGB32);
+    if(image.isNull()){
+        return QImage();
+    }
+    if(rawArgb){
+        for(int y = 0; y < frameHeight; y++){
+            qFromLittleEndian<quint32>(block + qsizetype(y) * frameWidth * 4, frameWidth, image.scanLine(y));
+        }
+    }
+    else{
+        for(int y = 0; y < frameHeight; y++){
+            QRgb *line = reinterpret_cast<QRgb*>(image.scanLine(y));
+            const uchar *indices = block + qsizetype(y) * frameWidth;
+            for(int x = 0; x < frameWidth; x++){
+                line[x] = indices[x] < palette.size() ? palette[indices[x]] : 0;
+            }
+        }
+    }
+    return image;
+}
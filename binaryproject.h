@@ -0,0 +1,96 @@
+#ifndef BINARYPROJECT_H
+#define BINARYPROJECT_H
+
+#include "projectreader.h"
+#include <QFile>
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QString>
+#include <vector>
+
+using std::vector;
+
+/**
+ * Binary .ssp layout, all integers little endian:
+ *
+ * header      magic "SSPB", version, header size, width, height,
+ *             frame count, palette size, flags
+ * palette     palette size ARGB entries shared by indexed frames
+ * frame table one entry per frame: offset, byte size, encoding
+ * durations   one entry per frame, milliseconds it is shown for,
+ *             only there if the FrameDurations flag is set
+ * frames      raw ARGB rows or one palette index byte per pixel,
+ *             frames with the same pixels may point at one block
+ *
+ * Mostly transparent frames are stored as sparse tiles instead:
+ * tile size, fill value, one bit per tile in row order, then the
+ * pixels of every tile whose bit is set. Tiles left out are
+ * filled with the fill value. Version 1 files have no sparse
+ * frames, so files without any are still written as version 1.
+ * Durations came with version 3, files without timing are
+ * written as before and older files read back with 0 for
+ * every frame.
+ *
+ * The reader maps the file and decodes frames on request, so
+ * a caller can show the first frame before the rest are read.
+ *
+ * Projects edited in indexed mode set the IndexedProject flag.
+ * Their palette is stored in the editor's order and their frames
+ * are read back as indexed images, other projects with few colors
+ * are only indexed on disk and read back as ARGB.
+ */
+class BinaryProject : public ProjectReader
+{
+public:
+    enum FrameEncoding : quint32 {
+        RawArgb = 0,
+        PaletteIndex = 1,
+        SparseArgb = 2,
+        SparseIndex = 3
+    };
+
+    enum Flags : quint32 {
+        IndexedProject = 1,
+        FrameDurations = 2
+    };
+
+    BinaryProject();
+    ~BinaryProject() override;
+
+    static bool isBinaryProject(const QString&);
+    static bool write(const QString&, const vector<QImage>&, const vector<int>& = vector<int>());
+
+    bool open(const QString&) override;
+    void close() override;
+    int width() const override;
+    int height() const override;
+    int frameCount() const override;
+    QImage frame(int) const override;
+    vector<int> frameDurations() const override;
+    QString errorString() const override;
+
+private:
+    QFile file;
+    uchar *data = nullptr;
+    qint64 dataSize = 0;
+    int frameWidth = 0;
+    int frameHeight = 0;
+    int numberOfFrames = 0;
+    QList<QRgb> palette;
+    vector<int> durations;
+    bool indexedProject = false;
+    const uchar *frameTable = nullptr;
+    QString error;
+
+    bool fail(const QString&);
+    static vector<QRgb> collectPalette(const vector<QImage>&);
+    static vector<QRgb> collectColors(const QImage&);
+    static QList<QRgb> projectPalette(const vector<QImage>&);
+    static QByteArray encodeFrame(const QImage&, const QHash<QRgb, uchar>*);
+    static QByteArray encodeIndices(const QImage&);
+    static QByteArray sparseTiles(const QByteArray&, int, int, int, quint32);
+    static bool expandTiles(const uchar*, quint32, int, int, int, QByteArray&);
+};
+
+#endif // BINARYPROJECT_H
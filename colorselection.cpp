@@ -8,6 +8,7 @@
 
 #include "colorselection.h"
 #include "ui_colorselection.h"
+#include <QPixmap>
 
 /**
  * @brief colorSelection::colorSelection
@@ -26,6 +27,7 @@ colorSelection::colorSelection(QWidget *parent) :
     this->setWindowTitle("Color Selection");
     newColor.setRgb(0,0,0,255);
     setNewColor();
+    showPalette(QList<QRgb>());
 
     //Button Setup
     connect(ui->closeButton, &QPushButton::clicked,
@@ -46,6 +48,12 @@ colorSelection::colorSelection(QWidget *parent) :
     //Combo Box Setup
     connect(ui->colorSelect, &QComboBox::activated,
             this, &colorSelection::updateNewColor);
+
+    //Palette Setup
+    connect(ui->paletteList, &QListWidget::currentRowChanged,
+            this, &colorSelection::selectPaletteColor);
+    connect(ui->replaceColorButton, &QPushButton::clicked,
+            this, &colorSelection::replaceColor);
 }
 
 /**
@@ -220,3 +228,62 @@ void colorSelection::setNewColor()
     ui->NewColorPreview->setStyleSheet("background-color:" + getColorString(newColor));
 }
 
+/**
+ * @brief colorSelection::showPalette
+ * shows the palette of an indexed sprite as swatches,
+ * the palette is empty when the sprite is not indexed
+ * @param colors
+ * colors of the palette in index order
+ */
+void colorSelection::showPalette(const QList<QRgb> &colors)
+{
+    int selected = ui->paletteList->currentRow();
+    paletteColors = colors;
+    ui->paletteList->blockSignals(true);
+    ui->paletteList->clear();
+    for(int index = 0; index < paletteColors.size(); index++){
+        QColor color = QColor::fromRgba(paletteColors[index]);
+        QPixmap swatch(ui->paletteList->iconSize());
+        swatch.fill(color);
+        QListWidgetItem *item = new QListWidgetItem(QIcon(swatch), QString(), ui->paletteList);
+        item->setToolTip(QString::number(index) + ": " + getColorString(color));
+    }
+    if(selected < paletteColors.size()){
+        ui->paletteList->setCurrentRow(selected);
+    }
+    ui->paletteList->blockSignals(false);
+    ui->paletteList->setEnabled(!paletteColors.isEmpty());
+    ui->replaceColorButton->setEnabled(!paletteColors.isEmpty());
+}
+
+/**
+ * @brief colorSelection::selectPaletteColor
+ * makes the chosen palette color the new color
+ * @param index
+ * row of the palette color in the list
+ */
+void colorSelection::selectPaletteColor(int index)
+{
+    if(index < 0 || index >= paletteColors.size()){
+        return;
+    }
+    newColor = QColor::fromRgba(paletteColors[index]);
+    setNewColor();
+    ui->rSlider->setValue(newColor.red());
+    ui->gSlider->setValue(newColor.green());
+    ui->bSlider->setValue(newColor.blue());
+    ui->aSlider->setValue(newColor.alpha());
+}
+
+/**
+ * @brief colorSelection::replaceColor
+ * asks for the selected palette color to be replaced by
+ * newColor, recoloring every pixel that uses it
+ */
+void colorSelection::replaceColor()
+{
+    int index = ui->paletteList->currentRow();
+    if(index >= 0){
+        emit replacePaletteColor(index, newColor);
+    }
+}
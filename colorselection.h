@@ -1,6 +1,7 @@
 #ifndef COLORSELECTION_H
 #define COLORSELECTION_H
 
+#include <QList>
 #include <QWidget>
 
 namespace Ui {
@@ -17,6 +18,7 @@ public:
 
 signals:
     void setColor(QColor);
+    void replacePaletteColor(int, QColor);
 
 public slots:
     void applyColor();
@@ -26,12 +28,16 @@ public slots:
     void updateNewA(int);
     void updateNewColor(int);
     void setCurrentColor(QColor);
+    void showPalette(const QList<QRgb>&);
 
 private:
     Ui::colorSelection *ui;
     QColor newColor, currentColor;
+    QList<QRgb> paletteColors;
 
     void setNewColor();
+    void selectPaletteColor(int);
+    void replaceColor();
     void sendColor();
     void closeEvent(QCloseEvent *event);
     QString getColorString(QColor);
@@ -1,13 +1,14 @@
 /**
  * @brief By Bryce Radle
  * Defines the behavior of mouse events for the
- * label that holds the image being modified
+ * canvas that holds the image being modified
  * Reviewed By:Keita Katanuma
  */
 
 #include "drawingui.h"
 #include <QMouseEvent>
 #include <QEvent>
+#include <QScreen>
 
 /**
  * @brief DrawingUi::DrawingUi
@@ -15,17 +16,20 @@
  * @param parent
  */
 DrawingUi::DrawingUi(QWidget *parent)
-    : QLabel{parent}
+    : FrameView{parent}
 {
-
+    flushTimer.setSingleShot(true);
+    connect(&flushTimer, &QTimer::timeout,
+            this, &DrawingUi::flushPoints);
 }
 
 /**
  * @brief DrawingUi::mousePressEvent
  * If the user has not selected a tool they cannot draw
- * When they do have a tool selected get the point they clicked
- * for the model to change pixels and tell the label the user is
+ * When they do have a tool selected get the sprite pixel they clicked
+ * for the model to change and tell the label the user is
  * drawing. This is so we can track movement when the mouse is held
+ * Everything drawn until the mouse is released is one stroke
  * @param event
  * Holds the mouse data from the computer
  */
@@ -36,15 +40,18 @@ void DrawingUi::mousePressEvent(QMouseEvent *event)
     }
 
     if (event->button() == Qt::LeftButton){
-        pointClicked = event->position().toPoint();
+        pointClicked = framePixel(event->position().toPoint());
         drawing = true;
+        emit strokeStarted();
         emit clicked(pointClicked);
     }
 }
 
 /**
  * @brief DrawingUi::mouseMoveEvent
- * When the user is drawing tell the model the points they pass over
+ * When the user is drawing collect the sprite pixels they pass over.
+ * They are sent to the model together once per screen refresh
+ * so fast mice do not redraw the frame for every event.
  * buttons is used here and not button to return the state
  * @param event
  * Holds data about the mouse changes
@@ -52,9 +59,39 @@ void DrawingUi::mousePressEvent(QMouseEvent *event)
 void DrawingUi::mouseMoveEvent(QMouseEvent *event)
 {
     if(drawing && (event->buttons() & Qt::LeftButton) && toolSelected){
-        pointClicked = event->position().toPoint();
-        emit clicked(pointClicked);
+        pointClicked = framePixel(event->position().toPoint());
+        pendingPoints.append(pointClicked);
+        if(!flushTimer.isActive()){
+            flushTimer.start(frameInterval());
+        }
+    }
+}
+
+/**
+ * @brief DrawingUi::flushPoints
+ * Sends the points collected since the last refresh to the model
+ */
+void DrawingUi::flushPoints()
+{
+    if(pendingPoints.isEmpty()){
+        return;
+    }
+    emit dragged(pendingPoints);
+    pendingPoints.clear();
+}
+
+/**
+ * @brief DrawingUi::frameInterval
+ * @return
+ * Milliseconds between refreshes of the screen showing the canvas
+ */
+int DrawingUi::frameInterval() const
+{
+    qreal refreshRate = screen() ? screen()->refreshRate() : 60.0;
+    if(refreshRate <= 0){
+        refreshRate = 60.0;
     }
+    return qMax(1, qRound(1000.0 / refreshRate));
 }
 
 /**
@@ -69,6 +106,9 @@ void DrawingUi::mouseReleaseEvent(QMouseEvent *event)
 {
     if(event->button() == Qt::LeftButton && drawing){
         drawing = false;
+        flushTimer.stop();
+        flushPoints();
+        emit strokeFinished();
     }
 }
 
@@ -82,4 +122,7 @@ void DrawingUi::mouseReleaseEvent(QMouseEvent *event)
 void DrawingUi::toolChosen(bool selected)
 {
     toolSelected = selected;
+    if(!selected){
+        pendingPoints.clear();
+    }
 }
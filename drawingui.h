@@ -1,10 +1,12 @@
 #ifndef DRAWINGUI_H
 #define DRAWINGUI_H
 
-#include <QLabel>
+#include "frameview.h"
+#include <QList>
+#include <QTimer>
 #include <QWidget>
 
-class DrawingUi : public QLabel
+class DrawingUi : public FrameView
 {
     Q_OBJECT
 public:
@@ -14,6 +16,10 @@ private:
     QPoint pointClicked;
     bool drawing = false;
     bool toolSelected = true;
+    QList<QPoint> pendingPoints;
+    QTimer flushTimer;
+    void flushPoints();
+    int frameInterval() const;
     void mousePressEvent(QMouseEvent *) override;
     void mouseMoveEvent(QMouseEvent *) override;
     void mouseReleaseEvent(QMouseEvent *) override;
@@ -23,6 +29,9 @@ public slots:
 
 signals:
     void clicked(QPoint);
+    void dragged(const QList<QPoint>&);
+    void strokeStarted();
+    void strokeFinished();
 };
 
 #endif // DRAWINGUI_H
@@ -0,0 +1,136 @@
+/**
+ * @brief Reads and writes sprite files away from the UI thread
+ * and reports progress back to the model through signals.
+ */
+
+#include "fileworker.h"
+#include <QFileInfo>
+#include <QThread>
+#include <memory>
+
+/**
+ * @brief FileWorker::FileWorker
+ * The worker is moved to its own thread by its owner, the frame
+ * lists it sends back cross threads so their types are registered
+ * @param parent
+ */
+FileWorker::FileWorker(QObject *parent)
+    : QObject{parent}
+{
+    qRegisterMetaType<vector<QImage>>();
+    qRegisterMetaType<vector<int>>();
+}
+
+/**
+ * @brief FileWorker::setCanceled
+ * Asks a running load to stop. Safe to call from any thread,
+ * the load checks it between batches of frames.
+ * @param cancel
+ * false before starting a load so an old cancel is forgotten
+ */
+void FileWorker::setCanceled(bool cancel)
+{
+    canceled = cancel;
+}
+
+/**
+ * @brief FileWorker::load
+ * Reads a png, jpg, gif or .ssp project, picking the reader by
+ * the file's extension
+ * @param fileName
+ */
+void FileWorker::load(const QString &fileName)
+{
+    const QString ext = QFileInfo(fileName).suffix().toLower();
+    if(ext == "ssp"){
+        loadProject(fileName);
+        return;
+    }
+
+    //images and GIFs are read in one go, the progress only shows
+    //that the worker is busy
+    emit progress(0, 0);
+    vector<QImage> frames;
+    vector<int> delays;
+    QString error;
+    bool read = ext == "gif"
+            ? SpriteFile::readGif(fileName, QSize(), frames, error, &delays)
+            : SpriteFile::readImage(fileName, QSize(), frames, error);
+    if(canceled){
+        emit loadCanceled();
+    }
+    else if(!read){
+        emit loadFailed(error);
+    }
+    else if(ext == "gif"){
+        emit gifLoaded(frames, delays);
+    }
+    else{
+        emit imageLoaded(frames.at(0));
+    }
+}
+
+/**
+ * @brief FileWorker::loadProject
+ * Opens a project and decodes its frames a batch at a time.
+ * Each batch is sent as soon as it is decoded, then all of the
+ * frames are sent again with identical frames sharing pixels.
+ * @param fileName
+ */
+void FileWorker::loadProject(const QString &fileName)
+{
+    emit progress(0, 0);
+    QString error;
+    std::unique_ptr<ProjectReader> project = SpriteFile::openProject(fileName, error);
+    if(!project || !SpriteFile::checkProjectSize(project->width(), project->height(), error)){
+        emit loadFailed(error);
+        return;
+    }
+    const int frameCount = project->frameCount();
+    if(frameCount == 0){
+        emit loadFailed("Unable to open project: it has no frames");
+        return;
+    }
+    if(canceled){
+        emit loadCanceled();
+        return;
+    }
+
+    emit projectOpened(QSize(project->width(), project->height()), frameCount, project->frameDurations());
+    vector<QImage> frames(frameCount);
+    //the first batch holds the first frame, so the canvas fills
+    //in almost at once while the rest are still being decoded
+    const int batchSize = qMax(1, QThread::idealThreadCount()) * 4;
+    for(int first = 0; first < frameCount; first += batchSize){
+        if(canceled){
+            emit loadCanceled();
+            return;
+        }
+        const int end = qMin(frameCount, first + batchSize);
+        SpriteFile::decodeFrameRange(*project, frames, first, end);
+        emit projectFramesLoaded(first, vector<QImage>(frames.begin() + first, frames.begin() + end));
+        emit progress(end, frameCount);
+    }
+    SpriteFile::shareDuplicateFrames(frames);
+    emit projectLoaded(frames);
+}
+
+/**
+ * @brief FileWorker::saveProject
+ * Writes a project. Saves are not canceled, the file is replaced
+ * atomically so a save either finishes or leaves the old file.
+ * @param fileName
+ * @param frames
+ * A copy of the model's frames, taken when the save was asked for
+ * @param durations
+ * The frames' durations, taken with them
+ * @param format
+ */
+void FileWorker::saveProject(const QString &fileName, const vector<QImage> &frames,
+                             const vector<int> &durations, SpriteFile::ProjectFormat format)
+{
+    emit progress(0, 0);
+    QString error;
+    bool saved = SpriteFile::writeProject(fileName, frames, durations, format, error);
+    emit projectSaved(saved, error);
+}
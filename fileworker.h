@@ -0,0 +1,53 @@
+#ifndef FILEWORKER_H
+#define FILEWORKER_H
+
+#include "spritefile.h"
+#include <QImage>
+#include <QObject>
+#include <QSize>
+#include <QString>
+#include <atomic>
+#include <vector>
+
+using std::vector;
+
+/**
+ * Loads and saves sprites on its own thread so the editor's
+ * window keeps responding while large files are read or written.
+ *
+ * The worker never touches the model. Loads report what they
+ * read through signals, projects a batch of frames at a time
+ * so the editor can show them as they arrive. Saves write the
+ * frames they are given, which share their pixels with the
+ * model's until the model draws on them.
+ */
+class FileWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FileWorker(QObject *parent = nullptr);
+
+    void setCanceled(bool);
+
+public slots:
+    void load(const QString&);
+    void saveProject(const QString&, const vector<QImage>&, const vector<int>&, SpriteFile::ProjectFormat);
+
+signals:
+    void progress(int, int);
+    void imageLoaded(const QImage&);
+    void gifLoaded(const vector<QImage>&, const vector<int>&);
+    void projectOpened(const QSize&, int, const vector<int>&);
+    void projectFramesLoaded(int, const vector<QImage>&);
+    void projectLoaded(const vector<QImage>&);
+    void loadFailed(const QString&);
+    void loadCanceled();
+    void projectSaved(bool, const QString&);
+
+private:
+    std::atomic<bool> canceled{false};
+
+    void loadProject(const QString&);
+};
+
+#endif // FILEWORKER_H
@@ -0,0 +1,246 @@
+/**
+ * @brief Displays a frame scaled to fit the widget, keeping its
+ * shape. Frames smaller than the widget are magnified by a whole
+ * number so every sprite pixel is the same size, large frames
+ * are shrunk to fit.
+ * The magnified frame is kept in a pixmap between edits so an
+ * edit only redraws and repaints the pixels it changed.
+ * The canvas and both previews are frame views, the previews
+ * also keep one pixmap per frame so playback only converts
+ * frames that were edited since they were last shown.
+ */
+
+#include "frameview.h"
+#include <QPainter>
+#include <QPaintEvent>
+#include <QtMath>
+
+/**
+ * @brief FrameView::FrameView
+ * Creates an empty view, the background shows until
+ * a frame is set
+ * @param parent
+ */
+FrameView::FrameView(QWidget *parent)
+    : QWidget{parent}
+{
+
+}
+
+/**
+ * @brief FrameView::showFrame
+ * Redraws the whole view from the frame
+ * @param frame
+ * The frame at sprite resolution
+ * @param palette
+ * Colors of an indexed frame
+ */
+void FrameView::showFrame(const TiledFrame &frame, const QList<QRgb> &palette)
+{
+    playingIndex = -1;
+    frameSize = frame.size();
+    if(canvas.size() != size()){
+        canvas = QPixmap(size());
+    }
+    canvas.fill(Qt::transparent);
+    QPainter painter(&canvas);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.drawImage(frameRect(), frame.toImage(palette));
+    painter.end();
+    update();
+}
+
+/**
+ * @brief FrameView::showRegion
+ * Redraws only the part of the view covering the changed
+ * sprite pixels and repaints only that part of the widget.
+ * Unless the frame is shrunk, only the changed pixels are copied
+ * out of its tiles.
+ * @param frame
+ * The frame at sprite resolution
+ * @param palette
+ * Colors of an indexed frame
+ * @param region
+ * The changed sprite pixels
+ */
+void FrameView::showRegion(const TiledFrame &frame, const QList<QRgb> &palette, const QRect &region)
+{
+    if(canvas.isNull() || frame.size() != frameSize){
+        showFrame(frame, palette);
+        return;
+    }
+    QRect target = canvasRect(region.intersected(frame.rect()));
+    if(target.isEmpty()){
+        return;
+    }
+    playingIndex = -1;
+    //the pixels are placed with the scale showFrame used and
+    //clipped to the target, so their edges land where it put them.
+    //Shrunk frames sample pixels of the whole frame, so all of it
+    //is drawn then.
+    const QRectF shown = frameRect();
+    const double scaleX = shown.width() / frameSize.width();
+    const double scaleY = shown.height() / frameSize.height();
+    const QRect pixels = scaleX < 1 || scaleY < 1 ? frame.rect() : region.intersected(frame.rect());
+    const QRectF placed(shown.left() + pixels.left() * scaleX, shown.top() + pixels.top() * scaleY,
+                        pixels.width() * scaleX, pixels.height() * scaleY);
+    QPainter painter(&canvas);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.setClipRect(target);
+    painter.drawImage(placed, frame.toImage(pixels, palette));
+    painter.end();
+    update(target);
+}
+
+/**
+ * @brief FrameView::playFrame
+ * Shows a frame of an animation. The magnified frame is cached
+ * per index and reused while its generation has not changed, so
+ * looping over unchanged frames does no conversion at all.
+ * @param index
+ * Position of the frame in the animation
+ * @param frame
+ * The frame at sprite resolution
+ * @param palette
+ * Colors of an indexed frame
+ * @param generation
+ * Changes whenever the frame's pixels or colors change
+ */
+void FrameView::playFrame(int index, const TiledFrame &frame, const QList<QRgb> &palette, qint64 generation)
+{
+    if(index == playingIndex && generation == playingGeneration && !canvas.isNull()){
+        return;
+    }
+    auto cached = cache.find(index);
+    if(cached != cache.end() && cached->generation == generation
+            && cached->pixmap.size() == size()){
+        //the pixmap is implicitly shared, nothing is copied
+        canvas = cached->pixmap;
+        frameSize = frame.size();
+        update();
+    }
+    else{
+        showFrame(frame, palette);
+        cache.insert(index, CachedFrame{generation, canvas});
+    }
+    playingIndex = index;
+    playingGeneration = generation;
+}
+
+/**
+ * @brief FrameView::trimCache
+ * Drops the cached pixmaps of frames that no longer exist
+ * @param frameCount
+ * Number of frames in the animation
+ */
+void FrameView::trimCache(int frameCount)
+{
+    for(auto cached = cache.begin(); cached != cache.end();){
+        if(cached.key() >= frameCount){
+            cached = cache.erase(cached);
+        }
+        else{
+            cached++;
+        }
+    }
+}
+
+/**
+ * @brief FrameView::clearFrame
+ * Removes the frame so only the background shows
+ */
+void FrameView::clearFrame()
+{
+    canvas = QPixmap();
+    frameSize = QSize();
+    playingIndex = -1;
+    update();
+}
+
+/**
+ * @brief FrameView::framePixel
+ * Maps a point on the widget to the sprite pixel under it
+ * @param point
+ * Widget coordinates
+ * @return
+ * The sprite pixel, outside the frame if the point is
+ */
+QPoint FrameView::framePixel(const QPoint &point) const
+{
+    QRectF shown = frameRect();
+    if(shown.isEmpty()){
+        return QPoint(-1, -1);
+    }
+    return QPoint(qFloor((point.x() - shown.left()) * frameSize.width() / shown.width()),
+                  qFloor((point.y() - shown.top()) * frameSize.height() / shown.height()));
+}
+
+/**
+ * @brief FrameView::frameRect
+ * @return
+ * The part of the canvas the frame is drawn on, centred
+ */
+QRectF FrameView::frameRect() const
+{
+    if(frameSize.isEmpty() || canvas.isNull()){
+        return QRectF();
+    }
+    double scale = qMin(canvas.width() / double(frameSize.width()),
+                        canvas.height() / double(frameSize.height()));
+    if(scale >= 1){
+        scale = qFloor(scale);
+    }
+    QSizeF shown(frameSize.width() * scale, frameSize.height() * scale);
+    return QRectF(QPointF((canvas.width() - shown.width()) / 2, (canvas.height() - shown.height()) / 2), shown);
+}
+
+/**
+ * @brief FrameView::canvasRect
+ * Maps sprite pixels to the widget pixels showing them,
+ * rounded outwards so partly covered pixels are included
+ * @param region
+ * Sprite pixels
+ * @return
+ * Widget pixels
+ */
+QRect FrameView::canvasRect(const QRect &region) const
+{
+    QRectF shown = frameRect();
+    if(shown.isEmpty()){
+        return QRect();
+    }
+    double scaleX = shown.width() / frameSize.width();
+    double scaleY = shown.height() / frameSize.height();
+    QPoint topLeft(qFloor(shown.left() + region.left() * scaleX), qFloor(shown.top() + region.top() * scaleY));
+    //the far edge is exclusive, one past the last covered pixel
+    QPoint end(qCeil(shown.left() + (region.right() + 1) * scaleX),
+               qCeil(shown.top() + (region.bottom() + 1) * scaleY));
+    return QRect(topLeft, QSize(end.x() - topLeft.x(), end.y() - topLeft.y())).intersected(canvas.rect());
+}
+
+/**
+ * @brief FrameView::paintEvent
+ * Copies the part of the pixmap that needs repainting
+ * @param event
+ */
+void FrameView::paintEvent(QPaintEvent *event)
+{
+    if(canvas.isNull()){
+        return;
+    }
+    QPainter painter(this);
+    painter.drawPixmap(event->rect(), canvas, event->rect());
+}
+
+/**
+ * @brief FrameView::resizeEvent
+ * The pixmaps no longer match the widget, they are rebuilt
+ * by the next showFrame or playFrame
+ * @param event
+ */
+void FrameView::resizeEvent(QResizeEvent *event)
+{
+    clearFrame();
+    cache.clear();
+    QWidget::resizeEvent(event);
+}
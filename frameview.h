@@ -0,0 +1,43 @@
+#ifndef FRAMEVIEW_H
+#define FRAMEVIEW_H
+
+#include "tiledframe.h"
+#include <QHash>
+#include <QList>
+#include <QPixmap>
+#include <QWidget>
+
+class FrameView : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit FrameView(QWidget *parent = nullptr);
+
+    void showFrame(const TiledFrame&, const QList<QRgb>&);
+    void showRegion(const TiledFrame&, const QList<QRgb>&, const QRect&);
+    void playFrame(int, const TiledFrame&, const QList<QRgb>&, qint64);
+    void trimCache(int);
+    void clearFrame();
+    QPoint framePixel(const QPoint&) const;
+
+protected:
+    void paintEvent(QPaintEvent *) override;
+    void resizeEvent(QResizeEvent *) override;
+
+private:
+    struct CachedFrame {
+        qint64 generation = 0;
+        QPixmap pixmap;
+    };
+
+    QPixmap canvas;
+    QSize frameSize;
+    QHash<int, CachedFrame> cache;
+    int playingIndex = -1;
+    qint64 playingGeneration = 0;
+
+    QRect canvasRect(const QRect&) const;
+    QRectF frameRect() const;
+};
+
+#endif // FRAMEVIEW_H
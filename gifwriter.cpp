@@ -0,0 +1,465 @@
+/**
+ * @brief Writes animated GIFs. Frames are quantized, reduced to
+ * the rectangle that changed and LZW compressed in parallel.
+ */
+
+#include "gifwriter.h"
+#include <QSaveFile>
+#include <QThread>
+#include <QtConcurrent>
+#include <algorithm>
+
+namespace {
+const int MAX_COLORS = 255;
+const int MAX_CODE = 4095;
+const int CODE_TABLE_SIZE = 8192;
+const uchar NETSCAPE_LOOP[19] = {0x21, 0xFF, 0x0B, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E',
+                                 '2', '.', '0', 0x03, 0x01, 0x00, 0x00, 0x00};
+
+void appendWord(QByteArray &data, int value)
+{
+    data.append(char(value & 0xff));
+    data.append(char((value >> 8) & 0xff));
+}
+
+int channel(QRgb color, int index)
+{
+    return index == 0 ? qRed(color) : index == 1 ? qGreen(color) : qBlue(color);
+}
+}
+
+/**
+ * @brief GifWriter::write
+ * Writes the frames as a GIF that loops forever. The file is
+ * replaced atomically so a failed export leaves no partial file.
+ * @param fileName
+ * @param frames
+ * Frames of the animation, all the same size
+ * @param durations
+ * Milliseconds each frame is shown for, a missing or 0 entry
+ * uses the default duration
+ * @param defaultDuration
+ * @return
+ * true if the GIF was written
+ */
+bool GifWriter::write(const QString &fileName, const vector<QImage> &frames,
+                      const vector<int> &durations, int defaultDuration)
+{
+    if(frames.empty()){
+        return false;
+    }
+    QSaveFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly)){
+        return false;
+    }
+
+    QByteArray header("GIF89a");
+    appendWord(header, frames.at(0).width());
+    appendWord(header, frames.at(0).height());
+    //no global color table, every frame has its own
+    header.append(char(0x70));
+    header.append('\0');
+    header.append('\0');
+    header.append(reinterpret_cast<const char*>(NETSCAPE_LOOP), sizeof(NETSCAPE_LOOP));
+    bool written = file.write(header) == header.size();
+
+    //encode a batch of frames at a time in parallel, then write them in order
+    auto encode = [&](int frameIndex){
+        int duration = frameIndex < static_cast<int>(durations.size()) && durations[frameIndex] > 0
+                ? durations[frameIndex] : defaultDuration;
+        return encodeFrame(frames, frameIndex, duration);
+    };
+    const int batchSize = qMax(1, QThread::idealThreadCount()) * 4;
+    const int frameCount = frames.size();
+    for(int first = 0; written && first < frameCount; first += batchSize){
+        vector<int> batch;
+        for(int frameIndex = first; frameIndex < qMin(frameCount, first + batchSize); frameIndex++){
+            batch.push_back(frameIndex);
+        }
+        const vector<QByteArray> blocks = QtConcurrent::blockingMapped<vector<QByteArray>>(batch, encode);
+        for(const QByteArray &block : blocks){
+            written = written && file.write(block) == block.size();
+        }
+    }
+    written = written && file.write(";", 1) == 1;
+
+    if(!written){
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+/**
+ * @brief GifWriter::encodeFrame
+ * Encodes one frame with its graphic control extension.
+ * A frame is drawn over the previous one and only stores the
+ * rectangle that changed. When the next frame turns some of
+ * this frame's pixels transparent, which drawing over cannot
+ * do, this frame is stored whole and cleared after it is shown.
+ * @param frames
+ * @param frameIndex
+ * The frame to encode
+ * @param duration
+ * Milliseconds the frame is shown for
+ * @return
+ * The frame's bytes as they appear in the file
+ */
+QByteArray GifWriter::encodeFrame(const vector<QImage> &frames, int frameIndex, int duration)
+{
+    const QImage frame = frames[frameIndex].convertToFormat(QImage::Format_ARGB32);
+    QImage previous;
+    if(frameIndex > 0){
+        previous = frames[frameIndex - 1].convertToFormat(QImage::Format_ARGB32);
+    }
+    const bool clearedBefore = frameIndex == 0 || needsClear(previous, frame);
+    const bool clearAfter = frameIndex + 1 < static_cast<int>(frames.size())
+            && needsClear(frame, frames[frameIndex + 1].convertToFormat(QImage::Format_ARGB32));
+    const QImage *canvas = clearedBefore ? nullptr : &previous;
+
+    QRect area = clearAfter ? frame.rect() : changedRect(canvas, frame);
+    if(area.isEmpty()){
+        area = QRect(0, 0, 1, 1);
+    }
+
+    //only pixels that differ from the canvas are drawn, the rest are transparent
+    auto drawn = [canvas, &frame](int x, int y){
+        QRgb pixel = reinterpret_cast<const QRgb*>(frame.constScanLine(y))[x];
+        if(!isOpaque(pixel)){
+            return false;
+        }
+        return canvas == nullptr
+                || !samePixel(reinterpret_cast<const QRgb*>(canvas->constScanLine(y))[x], pixel);
+    };
+
+    QHash<QRgb, int> counts;
+    for(int y = area.top(); y <= area.bottom(); y++){
+        const QRgb *line = reinterpret_cast<const QRgb*>(frame.constScanLine(y));
+        for(int x = area.left(); x <= area.right(); x++){
+            if(drawn(x, y)){
+                counts[line[x] | 0xff000000]++;
+            }
+        }
+    }
+    QHash<QRgb, uchar> paletteIndex;
+    const vector<QRgb> palette = quantize(counts, MAX_COLORS, paletteIndex);
+    const int transparentIndex = palette.size();
+    int tableBits = 1;
+    while((1 << tableBits) < transparentIndex + 1){
+        tableBits++;
+    }
+
+    QByteArray indices(area.width() * area.height(), Qt::Uninitialized);
+    char *index = indices.data();
+    for(int y = area.top(); y <= area.bottom(); y++){
+        const QRgb *line = reinterpret_cast<const QRgb*>(frame.constScanLine(y));
+        for(int x = area.left(); x <= area.right(); x++){
+            *index++ = char(drawn(x, y) ? paletteIndex.value(line[x] | 0xff000000) : transparentIndex);
+        }
+    }
+
+    QByteArray block;
+    //graphic control extension: disposal, transparency and delay
+    const int disposal = clearAfter ? 2 : 1;
+    block.append(char(0x21));
+    block.append(char(0xF9));
+    block.append(char(0x04));
+    block.append(char((disposal << 2) | 1));
+    appendWord(block, qBound(1, (duration + 5) / 10, 0xffff));
+    block.append(char(transparentIndex));
+    block.append('\0');
+
+    //image descriptor with a local color table
+    block.append(char(0x2C));
+    appendWord(block, area.left());
+    appendWord(block, area.top());
+    appendWord(block, area.width());
+    appendWord(block, area.height());
+    block.append(char(0x80 | (tableBits - 1)));
+    for(int entry = 0; entry < (1 << tableBits); entry++){
+        QRgb color = entry < transparentIndex ? palette[entry] : 0;
+        block.append(char(qRed(color)));
+        block.append(char(qGreen(color)));
+        block.append(char(qBlue(color)));
+    }
+    block.append(compress(indices, qMax(2, tableBits)));
+    return block;
+}
+
+/**
+ * @brief GifWriter::isOpaque
+ * @param pixel
+ * @return
+ * true if the pixel is written with a color rather than transparent
+ */
+bool GifWriter::isOpaque(QRgb pixel)
+{
+    return qAlpha(pixel) >= 128;
+}
+
+/**
+ * @brief GifWriter::samePixel
+ * @return
+ * true if the pixels look the same once written to the GIF
+ */
+bool GifWriter::samePixel(QRgb first, QRgb second)
+{
+    if(!isOpaque(first) || !isOpaque(second)){
+        return isOpaque(first) == isOpaque(second);
+    }
+    return (first & 0xffffff) == (second & 0xffffff);
+}
+
+/**
+ * @brief GifWriter::needsClear
+ * @param shown
+ * The frame on screen
+ * @param next
+ * The frame drawn after it
+ * @return
+ * true if the next frame makes a visible pixel transparent,
+ * so the shown frame must be cleared before it is drawn
+ */
+bool GifWriter::needsClear(const QImage &shown, const QImage &next)
+{
+    if(shown.size() != next.size()){
+        return true;
+    }
+    for(int y = 0; y < shown.height(); y++){
+        const QRgb *shownLine = reinterpret_cast<const QRgb*>(shown.constScanLine(y));
+        const QRgb *nextLine = reinterpret_cast<const QRgb*>(next.constScanLine(y));
+        for(int x = 0; x < shown.width(); x++){
+            if(isOpaque(shownLine[x]) && !isOpaque(nextLine[x])){
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief GifWriter::changedRect
+ * @param canvas
+ * What is on screen before the frame is drawn, or nullptr
+ * if the screen is clear
+ * @param frame
+ * @return
+ * The smallest rectangle holding every pixel that changes
+ */
+QRect GifWriter::changedRect(const QImage *canvas, const QImage &frame)
+{
+    int left = frame.width();
+    int right = -1;
+    int top = frame.height();
+    int bottom = -1;
+    for(int y = 0; y < frame.height(); y++){
+        const QRgb *line = reinterpret_cast<const QRgb*>(frame.constScanLine(y));
+        const QRgb *canvasLine = canvas ? reinterpret_cast<const QRgb*>(canvas->constScanLine(y)) : nullptr;
+        for(int x = 0; x < frame.width(); x++){
+            bool changed = canvasLine ? !samePixel(canvasLine[x], line[x]) : isOpaque(line[x]);
+            if(changed){
+                left = qMin(left, x);
+                right = qMax(right, x);
+                top = qMin(top, y);
+                bottom = qMax(bottom, y);
+            }
+        }
+    }
+    if(right < 0){
+        return QRect();
+    }
+    return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+/**
+ * @brief GifWriter::quantize
+ * Builds a color table for the colors of a frame. Frames with
+ * few enough colors keep them exactly, otherwise median cut
+ * splits the colors into boxes and each box becomes the
+ * average of its colors weighted by how often they are used.
+ * @param counts
+ * Pixels using each color
+ * @param maxColors
+ * Size limit of the table
+ * @param paletteIndex
+ * Filled with the table entry of every color
+ * @return
+ * The color table
+ */
+vector<QRgb> GifWriter::quantize(const QHash<QRgb, int> &counts, int maxColors, QHash<QRgb, uchar> &paletteIndex)
+{
+    struct Box {
+        vector<QRgb> colors;
+        int range = 0;
+        int widest = 0;
+    };
+    auto measure = [](Box &box){
+        int low[3] = {255, 255, 255};
+        int high[3] = {0, 0, 0};
+        for(QRgb color : box.colors){
+            for(int c = 0; c < 3; c++){
+                low[c] = qMin(low[c], channel(color, c));
+                high[c] = qMax(high[c], channel(color, c));
+            }
+        }
+        box.range = -1;
+        for(int c = 0; c < 3; c++){
+            if(high[c] - low[c] > box.range){
+                box.range = high[c] - low[c];
+                box.widest = c;
+            }
+        }
+    };
+
+    vector<Box> boxes(1);
+    for(auto color = counts.constBegin(); color != counts.constEnd(); color++){
+        boxes[0].colors.push_back(color.key());
+    }
+    if(static_cast<int>(boxes[0].colors.size()) <= maxColors){
+        vector<QRgb> palette = boxes[0].colors;
+        for(size_t entry = 0; entry < palette.size(); entry++){
+            paletteIndex.insert(palette[entry], static_cast<uchar>(entry));
+        }
+        return palette;
+    }
+
+    measure(boxes[0]);
+    while(static_cast<int>(boxes.size()) < maxColors){
+        int split = -1;
+        for(int b = 0; b < static_cast<int>(boxes.size()); b++){
+            if(boxes[b].colors.size() > 1 && (split < 0 || boxes[b].range > boxes[split].range)){
+                split = b;
+            }
+        }
+        if(split < 0 || boxes[split].range == 0){
+            break;
+        }
+        Box &box = boxes[split];
+        const int widest = box.widest;
+        std::sort(box.colors.begin(), box.colors.end(), [widest](QRgb a, QRgb b){
+            return channel(a, widest) < channel(b, widest);
+        });
+        //split where half the pixels are on each side
+        qint64 total = 0;
+        for(QRgb color : box.colors){
+            total += counts.value(color);
+        }
+        qint64 seen = 0;
+        size_t middle = 0;
+        while(middle < box.colors.size() - 1 && seen + counts.value(box.colors[middle]) <= total / 2){
+            seen += counts.value(box.colors[middle]);
+            middle++;
+        }
+        middle = qBound<size_t>(1, middle, box.colors.size() - 1);
+
+        Box upper;
+        upper.colors.assign(box.colors.begin() + middle, box.colors.end());
+        box.colors.resize(middle);
+        measure(box);
+        measure(upper);
+        boxes.push_back(std::move(upper));
+    }
+
+    vector<QRgb> palette;
+    for(const Box &box : boxes){
+        qint64 sum[3] = {0, 0, 0};
+        qint64 weight = 0;
+        for(QRgb color : box.colors){
+            int count = counts.value(color);
+            for(int c = 0; c < 3; c++){
+                sum[c] += qint64(channel(color, c)) * count;
+            }
+            weight += count;
+            paletteIndex.insert(color, static_cast<uchar>(palette.size()));
+        }
+        weight = qMax<qint64>(1, weight);
+        palette.push_back(qRgb(sum[0] / weight, sum[1] / weight, sum[2] / weight));
+    }
+    return palette;
+}
+
+/**
+ * @brief GifWriter::compress
+ * LZW compresses color indices the way GIF expects, with
+ * variable width codes packed from the low bit and the output
+ * split into blocks of at most 255 bytes
+ * @param indices
+ * One color table index per pixel
+ * @param minCodeSize
+ * Bits needed for the largest index, at least 2
+ * @return
+ * The image data as it appears in the file
+ */
+QByteArray GifWriter::compress(const QByteArray &indices, int minCodeSize)
+{
+    const int clearCode = 1 << minCodeSize;
+    const int endCode = clearCode + 1;
+    //string table: a hash of prefix code and next index to the string's code
+    vector<int> keys(CODE_TABLE_SIZE);
+    vector<int> codes(CODE_TABLE_SIZE);
+    int nextCode = 0;
+    int codeSize = 0;
+
+    QByteArray packed;
+    quint32 bitBuffer = 0;
+    int bitCount = 0;
+    auto writeCode = [&](int code){
+        bitBuffer |= quint32(code) << bitCount;
+        bitCount += codeSize;
+        while(bitCount >= 8){
+            packed.append(char(bitBuffer & 0xff));
+            bitBuffer >>= 8;
+            bitCount -= 8;
+        }
+    };
+    auto resetTable = [&](){
+        std::fill(keys.begin(), keys.end(), -1);
+        nextCode = endCode + 1;
+        codeSize = minCodeSize + 1;
+    };
+
+    resetTable();
+    writeCode(clearCode);
+    int prefix = uchar(indices.at(0));
+    for(int i = 1; i < indices.size(); i++){
+        const int pixel = uchar(indices.at(i));
+        const int key = (prefix << 8) | pixel;
+        int slot = (quint32(key) * 2654435761u) >> 19;
+        while(keys[slot] != -1 && keys[slot] != key){
+            slot = (slot + 1) & (CODE_TABLE_SIZE - 1);
+        }
+        if(keys[slot] == key){
+            prefix = codes[slot];
+            continue;
+        }
+        writeCode(prefix);
+        keys[slot] = key;
+        codes[slot] = nextCode;
+        if(nextCode >= (1 << codeSize)){
+            codeSize++;
+        }
+        if(nextCode == MAX_CODE){
+            writeCode(clearCode);
+            resetTable();
+        }
+        else{
+            nextCode++;
+        }
+        prefix = pixel;
+    }
+    writeCode(prefix);
+    writeCode(endCode);
+    if(bitCount > 0){
+        packed.append(char(bitBuffer & 0xff));
+    }
+
+    QByteArray data;
+    data.append(char(minCodeSize));
+    for(int pos = 0; pos < packed.size(); pos += 255){
+        const int length = qMin(255, int(packed.size()) - pos);
+        data.append(char(length));
+        data.append(packed.constData() + pos, length);
+    }
+    data.append('\0');
+    return data;
+}
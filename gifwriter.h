@@ -0,0 +1,42 @@
+#ifndef GIFWRITER_H
+#define GIFWRITER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QImage>
+#include <QRect>
+#include <QString>
+#include <vector>
+
+using std::vector;
+
+/**
+ * Writes frames as a looping animated GIF.
+ *
+ * Every frame gets its own color table, quantized with median
+ * cut when it uses more than 255 colors, and is LZW compressed.
+ * Only the rectangle that differs from the previous frame is
+ * stored, with unchanged pixels left transparent so they
+ * compress to almost nothing. Frames are encoded in parallel a
+ * batch at a time and written in order, so only one batch of
+ * encoded frames is held in memory.
+ *
+ * GIF transparency is all or nothing, pixels with less than
+ * half alpha are written transparent.
+ */
+class GifWriter
+{
+public:
+    static bool write(const QString&, const vector<QImage>&, const vector<int>&, int);
+
+private:
+    static QByteArray encodeFrame(const vector<QImage>&, int, int);
+    static bool isOpaque(QRgb);
+    static bool samePixel(QRgb, QRgb);
+    static bool needsClear(const QImage&, const QImage&);
+    static QRect changedRect(const QImage*, const QImage&);
+    static vector<QRgb> quantize(const QHash<QRgb, int>&, int, QHash<QRgb, uchar>&);
+    static QByteArray compress(const QByteArray&, int);
+};
+
+#endif // GIFWRITER_H
@@ -0,0 +1,668 @@
+/**
+ * @brief Keeps an append only journal of the edits to the frames
+ * next to a snapshot, so work survives the editor crashing.
+ */
+
+#include "journal.h"
+#include "binaryproject.h"
+#include "spritefile.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+const char MAGIC[4] = {'S', 'S', 'P', 'J'};
+const quint16 VERSION = 1;
+const int ENTRY_HEADER_SIZE = 8;
+//queued entries are handed to the writer this often
+const int FLUSH_INTERVAL_MS = 1000;
+//the journal is replaced by a snapshot once it holds this much
+const qint64 COMPACT_BYTES = 32 * 1024 * 1024;
+
+enum ImageFormat : quint32 {
+    ArgbImage = 0,
+    IndexedImage = 1
+};
+}
+
+/**
+ * @brief Journal::Journal
+ * The journal does nothing until it is opened
+ * @param frames
+ * @param durations
+ * @param palette
+ * The model's project, read when a snapshot is taken
+ * @param parent
+ */
+Journal::Journal(const vector<TiledFrame> &frames, const vector<int> &durations,
+                 const QList<QRgb> &palette, QObject *parent)
+    : QObject{parent}, frames(frames), durations(durations), palette(palette)
+{
+    //one writer keeps the entries in the order they were made
+    writer.setMaxThreadCount(1);
+    flushTimer.setSingleShot(true);
+    flushTimer.setInterval(FLUSH_INTERVAL_MS);
+    connect(&flushTimer, &QTimer::timeout,
+            this, &Journal::flush);
+}
+
+/**
+ * @brief Journal::~Journal
+ * Closing cleanly leaves nothing to recover
+ */
+Journal::~Journal()
+{
+    discard();
+}
+
+/**
+ * @brief Journal::open
+ * Takes the autosave directory for this editor
+ * @param path
+ * @return
+ * false if the directory cannot be used, or another editor
+ * has it
+ */
+bool Journal::open(const QString &path)
+{
+    if(!QDir().mkpath(path)){
+        return false;
+    }
+    lock = std::make_unique<QLockFile>(path + "/lock");
+    if(!lock->tryLock(0)){
+        lock.reset();
+        return false;
+    }
+    directory = path;
+    return true;
+}
+
+/**
+ * @brief Journal::hasRecovery
+ * @return
+ * true if a previous session left its journal behind
+ */
+bool Journal::hasRecovery() const
+{
+    return !directory.isEmpty() && QFile::exists(journalPath());
+}
+
+/**
+ * @brief Journal::recover
+ * Reads the snapshot of the previous session and replays its
+ * journal on top. Replaying stops at the first entry that was
+ * not completely written.
+ * @param recoveredFrames
+ * @param recoveredDurations
+ * @param recoveredPalette
+ * Replaced by the recovered project
+ * @param error
+ * Set to the reason if nothing could be recovered
+ * @return
+ * true if the project was recovered
+ */
+bool Journal::recover(vector<QImage> &recoveredFrames, vector<int> &recoveredDurations,
+                      QList<QRgb> &recoveredPalette, QString &error)
+{
+    QFile file(journalPath());
+    if(!file.open(QIODevice::ReadOnly)){
+        error = "Unable to read the autosave journal: " + file.errorString();
+        return false;
+    }
+    const QByteArray bytes = file.readAll();
+    QDataStream in(bytes);
+    in.setByteOrder(QDataStream::LittleEndian);
+
+    char magic[sizeof(MAGIC)];
+    quint16 version = 0;
+    quint16 reserved = 0;
+    quint32 snapshot = 0;
+    quint32 frameCount = 0;
+    if(in.readRawData(magic, sizeof(magic)) != sizeof(magic)
+            || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0){
+        error = "The autosave journal is damaged";
+        return false;
+    }
+    in >> version >> reserved >> snapshot >> frameCount;
+    if(version > VERSION || frameCount == 0 || frameCount > quint32(bytes.size())){
+        error = "The autosave journal is damaged";
+        return false;
+    }
+    vector<int> loadedDurations(frameCount);
+    for(int &duration : loadedDurations){
+        qint32 milliseconds = 0;
+        in >> milliseconds;
+        duration = milliseconds;
+    }
+    quint32 paletteSize = 0;
+    in >> paletteSize;
+    if(paletteSize > 256){
+        error = "The autosave journal is damaged";
+        return false;
+    }
+    QList<QRgb> loadedPalette(paletteSize);
+    for(QRgb &color : loadedPalette){
+        quint32 rgba = 0;
+        in >> rgba;
+        color = rgba;
+    }
+    if(in.status() != QDataStream::Ok){
+        error = "The autosave journal is damaged";
+        return false;
+    }
+
+    vector<QImage> loadedFrames;
+    if(!SpriteFile::readProject(snapshotPath(snapshot), loadedFrames, error)){
+        return false;
+    }
+    if(loadedFrames.size() != frameCount){
+        error = "The autosave snapshot does not match its journal";
+        return false;
+    }
+    for(QImage &frame : loadedFrames){
+        if(loadedPalette.isEmpty()){
+            frame = frame.convertToFormat(QImage::Format_ARGB32);
+        }
+        else if(frame.format() == QImage::Format_Indexed8){
+            frame.setColorTable(loadedPalette);
+        }
+        else{
+            frame = frame.convertToFormat(QImage::Format_Indexed8, loadedPalette);
+        }
+    }
+
+    //entries after the last complete one were cut off by the crash
+    qint64 offset = bytes.size() - in.device()->bytesAvailable();
+    while(offset + ENTRY_HEADER_SIZE <= bytes.size()){
+        const uchar *header = reinterpret_cast<const uchar*>(bytes.constData() + offset);
+        const quint32 size = qFromLittleEndian<quint32>(header);
+        const quint16 checksum = qFromLittleEndian<quint16>(header + 4);
+        const quint16 kind = qFromLittleEndian<quint16>(header + 6);
+        if(size > bytes.size() - offset - ENTRY_HEADER_SIZE){
+            break;
+        }
+        const QByteArray payload = QByteArray::fromRawData(bytes.constData() + offset + ENTRY_HEADER_SIZE, size);
+        if(qChecksum(payload) != checksum
+                || !applyEntry(kind, payload, loadedFrames, loadedDurations, loadedPalette)){
+            break;
+        }
+        offset += ENTRY_HEADER_SIZE + size;
+    }
+    if(loadedFrames.empty()){
+        error = "The autosave journal is damaged";
+        return false;
+    }
+
+    generation = snapshot;
+    recoveredFrames.swap(loadedFrames);
+    recoveredDurations.swap(loadedDurations);
+    recoveredPalette = loadedPalette;
+    return true;
+}
+
+/**
+ * @brief Journal::recordSteps
+ * Queues the changes a group of the undo history made. Only
+ * image handles are kept here, the pixels are encoded on the
+ * writer thread.
+ * @param steps
+ * The group's steps
+ * @param undone
+ * true if the group was undone, its steps are then replayed
+ * backwards with their old values
+ */
+void Journal::recordSteps(const vector<UndoHistory::Step> &steps, bool undone)
+{
+    if(directory.isEmpty()){
+        return;
+    }
+    auto record = [this, undone](const UndoHistory::Step &step){
+        Entry entry;
+        entry.frame = step.frame;
+        switch(step.kind){
+        case UndoHistory::Tile:
+            entry.kind = Pixels;
+            entry.area = step.area;
+            entry.image = undone ? step.before : step.after;
+            break;
+        case UndoHistory::InsertFrame:
+        case UndoHistory::RemoveFrame:
+            if((step.kind == UndoHistory::InsertFrame) != undone){
+                entry.kind = InsertFrame;
+                entry.wholeFrame = undone ? step.frameBefore : step.frameAfter;
+                entry.duration = undone ? step.durationBefore : step.durationAfter;
+            }
+            else{
+                entry.kind = RemoveFrame;
+            }
+            break;
+        case UndoHistory::MoveFrame:
+            entry.kind = MoveFrame;
+            entry.frame = undone ? step.frameTo : step.frame;
+            entry.frameTo = undone ? step.frame : step.frameTo;
+            break;
+        case UndoHistory::ReplaceFrame:
+            entry.kind = ReplaceFrame;
+            entry.wholeFrame = undone ? step.frameBefore : step.frameAfter;
+            break;
+        case UndoHistory::SpriteSize:
+            //the size comes with the replaced frames
+            return;
+        case UndoHistory::FrameDuration:
+            entry.kind = FrameDuration;
+            entry.duration = undone ? step.durationBefore : step.durationAfter;
+            break;
+        case UndoHistory::Palette:
+            entry.kind = Palette;
+            entry.palette = undone ? step.paletteBefore : step.paletteAfter;
+            break;
+        }
+        append(entry);
+    };
+    if(undone){
+        std::for_each(steps.rbegin(), steps.rend(), record);
+    }
+    else{
+        std::for_each(steps.begin(), steps.end(), record);
+    }
+}
+
+/**
+ * @brief Journal::append
+ * Queues an entry for the next flush
+ * @param entry
+ */
+void Journal::append(Entry entry)
+{
+    pendingBytes += ENTRY_HEADER_SIZE + entry.image.sizeInBytes() + entry.wholeFrame.sizeInBytes()
+            + entry.palette.size() * 4;
+    pending.push_back(std::move(entry));
+    if(!flushTimer.isActive()){
+        flushTimer.start();
+    }
+}
+
+/**
+ * @brief Journal::flush
+ * Hands the queued entries to the writer thread, which encodes
+ * and appends them. Once the journal is large it is replaced
+ * by a snapshot, and after a snapshot failed another one is
+ * tried in place of appending.
+ */
+void Journal::flush()
+{
+    if(directory.isEmpty() || pending.empty()){
+        return;
+    }
+    if(snapshotFailed){
+        snapshot();
+        return;
+    }
+    journalBytes += pendingBytes;
+    pendingBytes = 0;
+    vector<Entry> batch;
+    batch.swap(pending);
+    writer.start([this, path = journalPath(), batch]{
+        //a snapshot queued before this one failed, the entries
+        //would be replayed on the wrong frames
+        if(snapshotFailed){
+            return;
+        }
+        QByteArray bytes;
+        for(const Entry &entry : batch){
+            bytes += encodeEntry(entry);
+        }
+        //flushed to the system, so the entries outlive the editor
+        //crashing though not the machine losing power
+        QFile file(path);
+        if(file.open(QIODevice::WriteOnly | QIODevice::Append)){
+            file.write(bytes);
+            file.flush();
+        }
+    });
+    if(journalBytes > COMPACT_BYTES){
+        snapshot();
+    }
+}
+
+/**
+ * @brief Journal::snapshot
+ * Starts the journal over from the current frames. Queued
+ * entries are dropped since the snapshot already has them.
+ * The new journal replaces the old one only after the snapshot
+ * is written, so a crash part way leaves the old pair intact.
+ * When writing fails the old pair is kept as it is, and flushes
+ * try again with a new snapshot instead of appending to it.
+ */
+void Journal::snapshot()
+{
+    if(directory.isEmpty() || frames.empty()){
+        return;
+    }
+    flushTimer.stop();
+    pending.clear();
+    pendingBytes = 0;
+    journalBytes = 0;
+    generation++;
+    writer.start([this, directory = directory, snapshotFile = snapshotPath(generation), journalFile = journalPath(),
+                  frameCopy = frames, durationCopy = durations, paletteCopy = palette, snapshot = generation]{
+        if(!writeSnapshot(snapshotFile, journalFile, frameCopy, durationCopy, paletteCopy, snapshot)){
+            QFile::remove(snapshotFile);
+            snapshotFailed = true;
+            return;
+        }
+        snapshotFailed = false;
+        QDir autosave(directory);
+        const QString current = QFileInfo(snapshotFile).fileName();
+        for(const QString &old : autosave.entryList({"snapshot-*.ssp"}, QDir::Files)){
+            if(old != current){
+                autosave.remove(old);
+            }
+        }
+    });
+}
+
+/**
+ * @brief Journal::discard
+ * Waits for the writer and removes the autosave files
+ */
+void Journal::discard()
+{
+    if(directory.isEmpty()){
+        return;
+    }
+    flushTimer.stop();
+    pending.clear();
+    writer.waitForDone();
+    QDir autosave(directory);
+    autosave.remove("journal");
+    for(const QString &old : autosave.entryList({"snapshot-*.ssp"}, QDir::Files)){
+        autosave.remove(old);
+    }
+    lock.reset();
+    directory.clear();
+}
+
+QString Journal::journalPath() const
+{
+    return directory + "/journal";
+}
+
+QString Journal::snapshotPath(quint32 snapshot) const
+{
+    return directory + QString("/snapshot-%1.ssp").arg(snapshot);
+}
+
+/**
+ * @brief Journal::writeSnapshot
+ * Writes the frames as a binary project, then a new journal
+ * holding what the project format does not
+ * @param snapshotFile
+ * @param journalFile
+ * @param frames
+ * @param durations
+ * @param palette
+ * @param snapshot
+ * Number of the snapshot the journal refers to
+ * @return
+ * true if both files were written
+ */
+bool Journal::writeSnapshot(const QString &snapshotFile, const QString &journalFile,
+                            const vector<TiledFrame> &frames, const vector<int> &durations,
+                            const QList<QRgb> &palette, quint32 snapshot)
+{
+    if(!BinaryProject::write(snapshotFile, TiledFrame::toImages(frames, palette))){
+        return false;
+    }
+    QSaveFile file(journalFile);
+    if(!file.open(QIODevice::WriteOnly)){
+        return false;
+    }
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData(MAGIC, sizeof(MAGIC));
+    out << VERSION << quint16(0) << snapshot << quint32(frames.size());
+    for(size_t frame = 0; frame < frames.size(); frame++){
+        out << qint32(frame < durations.size() ? durations[frame] : 0);
+    }
+    out << quint32(palette.size());
+    for(QRgb color : palette){
+        out << quint32(color);
+    }
+    if(out.status() != QDataStream::Ok){
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+/**
+ * @brief Journal::encodeEntry
+ * @param entry
+ * @return
+ * The entry's header and payload as stored in the journal
+ */
+QByteArray Journal::encodeEntry(const Entry &entry)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::LittleEndian);
+    switch(entry.kind){
+    case Pixels:
+        //tiles on the frame's edge reach past it
+        out << qint32(entry.frame) << qint32(entry.area.left()) << qint32(entry.area.top());
+        writeImage(out, entry.image.copy(QRect(QPoint(0, 0), entry.area.size())));
+        break;
+    case InsertFrame:
+        out << qint32(entry.frame) << qint32(entry.duration);
+        writeImage(out, entry.wholeFrame.toImage());
+        break;
+    case RemoveFrame:
+        out << qint32(entry.frame);
+        break;
+    case MoveFrame:
+        out << qint32(entry.frame) << qint32(entry.frameTo);
+        break;
+    case ReplaceFrame:
+        out << qint32(entry.frame);
+        writeImage(out, entry.wholeFrame.toImage());
+        break;
+    case FrameDuration:
+        out << qint32(entry.frame) << qint32(entry.duration);
+        break;
+    case Palette:
+        out << quint32(entry.palette.size());
+        for(QRgb color : entry.palette){
+            out << quint32(color);
+        }
+        break;
+    }
+
+    QByteArray bytes(ENTRY_HEADER_SIZE, Qt::Uninitialized);
+    qToLittleEndian<quint32>(payload.size(), bytes.data());
+    qToLittleEndian<quint16>(qChecksum(payload), bytes.data() + 4);
+    qToLittleEndian<quint16>(entry.kind, bytes.data() + 6);
+    return bytes + payload;
+}
+
+/**
+ * @brief Journal::applyEntry
+ * Replays one entry on the recovered project
+ * @param kind
+ * @param payload
+ * @param frames
+ * @param durations
+ * @param palette
+ * @return
+ * false if the entry does not fit the project, which ends
+ * the replay
+ */
+bool Journal::applyEntry(quint16 kind, const QByteArray &payload, vector<QImage> &frames,
+                         vector<int> &durations, QList<QRgb> &palette)
+{
+    QDataStream in(payload);
+    in.setByteOrder(QDataStream::LittleEndian);
+    const int frameCount = frames.size();
+    qint32 frame = 0;
+    qint32 value = 0;
+    qint32 y = 0;
+    switch(kind){
+    case Pixels: {
+        in >> frame >> value >> y;
+        QImage tile = readImage(in, palette);
+        if(frame < 0 || frame >= frameCount || tile.isNull() || tile.format() != frames[frame].format()
+                || !frames[frame].rect().contains(QRect(QPoint(value, y), tile.size()))){
+            return false;
+        }
+        UndoHistory::blit(frames[frame], tile, QPoint(value, y));
+        return true;
+    }
+    case InsertFrame: {
+        in >> frame >> value;
+        QImage inserted = readImage(in, palette);
+        if(frame < 0 || frame > frameCount || inserted.isNull()){
+            return false;
+        }
+        frames.insert(frames.begin() + frame, inserted);
+        durations.insert(durations.begin() + frame, value);
+        return true;
+    }
+    case RemoveFrame:
+        in >> frame;
+        if(frame < 0 || frame >= frameCount || frameCount == 1){
+            return false;
+        }
+        frames.erase(frames.begin() + frame);
+        durations.erase(durations.begin() + frame);
+        return true;
+    case MoveFrame:
+        in >> frame >> value;
+        if(frame < 0 || frame >= frameCount || value < 0 || value >= frameCount){
+            return false;
+        }
+        if(frame < value){
+            std::rotate(frames.begin() + frame, frames.begin() + frame + 1, frames.begin() + value + 1);
+            std::rotate(durations.begin() + frame, durations.begin() + frame + 1, durations.begin() + value + 1);
+        }
+        else{
+            std::rotate(frames.begin() + value, frames.begin() + frame, frames.begin() + frame + 1);
+            std::rotate(durations.begin() + value, durations.begin() + frame, durations.begin() + frame + 1);
+        }
+        return true;
+    case ReplaceFrame: {
+        in >> frame;
+        QImage replacement = readImage(in, palette);
+        if(frame < 0 || frame >= frameCount || replacement.isNull()){
+            return false;
+        }
+        frames[frame] = replacement;
+        return true;
+    }
+    case FrameDuration:
+        in >> frame >> value;
+        if(frame < 0 || frame >= frameCount || in.status() != QDataStream::Ok){
+            return false;
+        }
+        durations[frame] = value;
+        return true;
+    case Palette: {
+        quint32 size = 0;
+        in >> size;
+        if(size > 256){
+            return false;
+        }
+        QList<QRgb> colors(size);
+        for(QRgb &color : colors){
+            quint32 rgba = 0;
+            in >> rgba;
+            color = rgba;
+        }
+        if(in.status() != QDataStream::Ok){
+            return false;
+        }
+        palette = colors;
+        for(QImage &indexed : frames){
+            if(indexed.format() == QImage::Format_Indexed8){
+                indexed.setColorTable(palette);
+            }
+        }
+        return true;
+    }
+    }
+    return false;
+}
+
+/**
+ * @brief Journal::writeImage
+ * Writes the size, format and rows of an ARGB or indexed image
+ * @param out
+ * @param image
+ */
+void Journal::writeImage(QDataStream &out, const QImage &image)
+{
+    const bool indexed = image.format() == QImage::Format_Indexed8;
+    const QImage pixels = indexed ? image : image.convertToFormat(QImage::Format_ARGB32);
+    out << quint32(pixels.width()) << quint32(pixels.height())
+        << quint32(indexed ? IndexedImage : ArgbImage);
+    QByteArray row(pixels.width() * (indexed ? 1 : 4), Qt::Uninitialized);
+    for(int y = 0; y < pixels.height(); y++){
+        if(indexed){
+            std::memcpy(row.data(), pixels.constScanLine(y), row.size());
+        }
+        else{
+            qToLittleEndian<quint32>(pixels.constScanLine(y), pixels.width(), row.data());
+        }
+        out.writeRawData(row.constData(), row.size());
+    }
+}
+
+/**
+ * @brief Journal::readImage
+ * @param in
+ * @param palette
+ * Color table given to indexed images
+ * @return
+ * The image, or a null image if it is damaged
+ */
+QImage Journal::readImage(QDataStream &in, const QList<QRgb> &palette)
+{
+    quint32 width = 0;
+    quint32 height = 0;
+    quint32 format = 0;
+    in >> width >> height >> format;
+    if(in.status() != QDataStream::Ok || width == 0 || height == 0
+            || width > quint32(SpriteFile::MAX_SIDE) || height > quint32(SpriteFile::MAX_SIDE)
+            || format > IndexedImage){
+        return QImage();
+    }
+    const bool indexed = format == IndexedImage;
+    QImage image(width, height, indexed ? QImage::Format_Indexed8 : QImage::Format_ARGB32);
+    QByteArray row(width * (indexed ? 1 : 4), Qt::Uninitialized);
+    for(quint32 y = 0; y < height; y++){
+        if(in.readRawData(row.data(), row.size()) != row.size()){
+            return QImage();
+        }
+        if(indexed){
+            std::memcpy(image.scanLine(y), row.constData(), row.size());
+        }
+        else{
+            qFromLittleEndian<quint32>(row.constData(), width, image.scanLine(y));
+        }
+    }
+    if(indexed){
+        for(quint32 y = 0; y < height; y++){
+            const uchar *indices = image.constScanLine(y);
+            for(quint32 x = 0; x < width; x++){
+                if(indices[x] >= palette.size()){
+                    return QImage();
+                }
+            }
+        }
+        image.setColorTable(palette);
+    }
+    return image;
+}
@@ -0,0 +1,105 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "undohistory.h"
+#include <QDataStream>
+#include <QImage>
+#include <QList>
+#include <QLockFile>
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+#include <QTimer>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+using std::vector;
+
+/**
+ * Crash recovery for the model's frames.
+ *
+ * Every group the undo history commits, undoes or redoes is
+ * appended to a journal as the changes it made, tiles for pixel
+ * edits and whole frames only for inserts and replacements.
+ * Entries are only queued while drawing, a timer hands them to
+ * a writer thread about once a second. When the journal grows
+ * large, or the project is replaced, the frames are written as a
+ * snapshot and the journal starts over from it. If a snapshot
+ * cannot be written, nothing more is appended until one is, so
+ * the old snapshot and journal still recover together.
+ *
+ * autosave directory
+ * snapshot-N.ssp  binary project of the frames at snapshot N
+ * journal         magic "SSPJ", version, snapshot N, frame count,
+ *                 frame durations, then entries of: payload size,
+ *                 payload checksum, kind, payload
+ *
+ * The files are removed on a clean exit, finding them at start
+ * up means the editor did not get to close.
+ */
+class Journal : public QObject
+{
+    Q_OBJECT
+public:
+    Journal(const vector<TiledFrame> &frames, const vector<int> &durations, const QList<QRgb> &palette,
+            QObject *parent = nullptr);
+    ~Journal();
+
+    bool open(const QString&);
+    bool hasRecovery() const;
+    bool recover(vector<QImage>&, vector<int>&, QList<QRgb>&, QString&);
+    void recordSteps(const vector<UndoHistory::Step>&, bool);
+    void snapshot();
+    void discard();
+
+private:
+    enum EntryKind : quint16 {
+        Pixels = 1,
+        InsertFrame,
+        RemoveFrame,
+        MoveFrame,
+        ReplaceFrame,
+        FrameDuration,
+        Palette
+    };
+
+    struct Entry {
+        EntryKind kind = Pixels;
+        int frame = -1;
+        int frameTo = -1;
+        QRect area;
+        QImage image;
+        TiledFrame wholeFrame;
+        int duration = 0;
+        QList<QRgb> palette;
+    };
+
+    const vector<TiledFrame> &frames;
+    const vector<int> &durations;
+    const QList<QRgb> &palette;
+    QString directory;
+    std::unique_ptr<QLockFile> lock;
+    QThreadPool writer;
+    QTimer flushTimer;
+    vector<Entry> pending;
+    qint64 pendingBytes = 0;
+    qint64 journalBytes = 0;
+    quint32 generation = 0;
+    //set by the writer when a snapshot fails, the journal on disk
+    //then no longer leads to the frames being edited
+    std::atomic<bool> snapshotFailed{false};
+
+    void flush();
+    void append(Entry);
+    QString journalPath() const;
+    QString snapshotPath(quint32) const;
+    static QByteArray encodeEntry(const Entry&);
+    static bool applyEntry(quint16, const QByteArray&, vector<QImage>&, vector<int>&, QList<QRgb>&);
+    static void writeImage(QDataStream&, const QImage&);
+    static QImage readImage(QDataStream&, const QList<QRgb>&);
+    static bool writeSnapshot(const QString&, const QString&, const vector<TiledFrame>&,
+                              const vector<int>&, const QList<QRgb>&, quint32);
+};
+
+#endif // JOURNAL_H
@@ -0,0 +1,648 @@
+/**
+ * @brief Reads and writes the JSON .ssp project format.
+ * Pixels go straight between the image scanlines and the file
+ * text, so no QJsonArray is built per pixel and saving or loading
+ * a project is bound by the disk rather than the allocator.
+ */
+
+#include "jsonproject.h"
+#include <QThread>
+#include <QtConcurrent>
+#include <algorithm>
+#include <climits>
+
+namespace {
+const QRgb EMPTY_PIXEL = qRgba(255, 255, 255, 0);
+const int INDENT_WIDTH = 4;
+const int MAX_SIDE = 1 << 15;
+const int MAX_FRAMES = 1 << 20;
+
+/**
+ * @brief newLine
+ * Starts a new line at the given depth, matching the
+ * layout of QJsonDocument::Indented
+ */
+void newLine(QByteArray &out, int depth)
+{
+    out += '\n';
+    out.append(depth * INDENT_WIDTH, ' ');
+}
+
+/**
+ * @brief appendChannel
+ * Writes a color channel as decimal text
+ */
+void appendChannel(QByteArray &out, int value)
+{
+    if(value >= 100){
+        out += char('0' + value / 100);
+        value %= 100;
+        out += char('0' + value / 10);
+    }
+    else if(value >= 10){
+        out += char('0' + value / 10);
+    }
+    out += char('0' + value % 10);
+}
+}
+
+/**
+ * @brief JsonProject::JsonProject
+ * Creates a reader with no file open
+ */
+JsonProject::JsonProject()
+{
+
+}
+
+/**
+ * @brief JsonProject::~JsonProject
+ * Unmaps and closes the project file
+ */
+JsonProject::~JsonProject()
+{
+    close();
+}
+
+/**
+ * @brief JsonProject::encodeFrame
+ * Converts one frame into the JSON array of rows of RGBA arrays
+ * @param image
+ * The frame to encode
+ * @param compact
+ * true to leave out all whitespace, false for the indented layout
+ * @return
+ * The text of the frame array
+ */
+QByteArray JsonProject::encodeFrame(const QImage &image, bool compact)
+{
+    const QImage frame = image.convertToFormat(QImage::Format_ARGB32);
+    const int width = frame.width();
+    const int height = frame.height();
+
+    //indented pixels take about 90 bytes, compact ones about 16
+    QByteArray out;
+    out.reserve(qsizetype(width) * height * (compact ? 16 : 90) + height * 32);
+
+    out += '[';
+    for(int y = 0; y < height; y++){
+        if(y > 0){
+            out += ',';
+        }
+        if(!compact){
+            newLine(out, 3);
+        }
+        out += '[';
+        const QRgb *line = reinterpret_cast<const QRgb*>(frame.constScanLine(y));
+        for(int x = 0; x < width; x++){
+            if(x > 0){
+                out += ',';
+            }
+            if(!compact){
+                newLine(out, 4);
+            }
+            out += '[';
+            const int channels[4] = {qRed(line[x]), qGreen(line[x]), qBlue(line[x]), qAlpha(line[x])};
+            for(int channel = 0; channel < 4; channel++){
+                if(channel > 0){
+                    out += ',';
+                }
+                if(!compact){
+                    newLine(out, 5);
+                }
+                appendChannel(out, channels[channel]);
+            }
+            if(!compact){
+                newLine(out, 4);
+            }
+            out += ']';
+        }
+        if(!compact){
+            newLine(out, 3);
+        }
+        out += ']';
+    }
+    if(!compact){
+        newLine(out, 2);
+    }
+    out += ']';
+    return out;
+}
+
+/**
+ * @brief JsonProject::write
+ * Streams the project to the device one frame at a time
+ * @param device
+ * Open device to write to
+ * @param frames
+ * Frames of the project, all the same size
+ * @param compact
+ * true to leave out all whitespace, false for the indented layout
+ * @param durations
+ * Milliseconds each frame is shown for, missing entries are 0.
+ * Without any timing the durations are left out of the file.
+ * @return
+ * true if everything was written
+ */
+bool JsonProject::write(QIODevice *device, const vector<QImage> &frames, bool compact,
+                        const vector<int> &durations)
+{
+    if(frames.empty()){
+        return false;
+    }
+    const QByteArray separator = compact ? ":" : ": ";
+    const QByteArray topLevel = compact ? "" : "\n    ";
+    const QByteArray frameLevel = compact ? "" : "\n        ";
+    bool ok = true;
+    auto put = [&](const QByteArray &text){
+        ok = ok && device->write(text) == text.size();
+    };
+
+    //encode a batch of frames at a time in parallel, then write them in order
+    auto encode = [compact](const QImage &frame){
+        return encodeFrame(frame, compact);
+    };
+    const size_t batchSize = qMax(1, QThread::idealThreadCount()) * 4;
+
+    put("{");
+    if(std::any_of(durations.begin(), durations.end(), [](int duration){ return duration > 0; })){
+        put(topLevel + "\"durations\"" + separator + "[");
+        for(size_t index = 0; index < frames.size(); index++){
+            const int duration = index < durations.size() ? qMax(0, durations[index]) : 0;
+            put((index > 0 ? "," : "") + frameLevel + QByteArray::number(duration));
+        }
+        put(topLevel + "],");
+    }
+    put(topLevel + "\"frames\"" + separator + "{");
+    for(size_t first = 0; first < frames.size() && ok; first += batchSize){
+        const vector<QImage> batch(frames.begin() + first,
+                                   frames.begin() + qMin(frames.size(), first + batchSize));
+        const vector<QByteArray> encoded = QtConcurrent::blockingMapped<vector<QByteArray>>(batch, encode);
+        for(size_t offset = 0; offset < encoded.size(); offset++){
+            size_t index = first + offset;
+            if(index > 0){
+                put(",");
+            }
+            put(frameLevel + "\"frame" + QByteArray::number(qulonglong(index)) + "\"" + separator);
+            put(encoded[offset]);
+        }
+    }
+    put(topLevel + "},");
+    put(topLevel + "\"height\"" + separator + QByteArray::number(frames.at(0).height()) + ",");
+    put(topLevel + "\"numberOfFrames\"" + separator + QByteArray::number(qulonglong(frames.size())) + ",");
+    put(topLevel + "\"width\"" + separator + QByteArray::number(frames.at(0).width()));
+    put(compact ? "}" : "\n}\n");
+    return ok;
+}
+
+/**
+ * @brief JsonProject::open
+ * Maps the file and walks the top level object once, reading the
+ * size fields and noting where each frame array starts.
+ * @param fileName
+ * @return
+ * true if the file is a readable JSON project
+ */
+bool JsonProject::open(const QString &fileName)
+{
+    close();
+    file.setFileName(fileName);
+    if(!file.open(QIODevice::ReadOnly)){
+        return fail(file.errorString());
+    }
+    dataSize = file.size();
+    data = file.map(0, dataSize);
+    if(data == nullptr){
+        return fail("Unable to map the project file");
+    }
+
+    qint64 pos = 0;
+    if(!expect(pos, '{')){
+        return fail("Project is not a JSON object");
+    }
+    skipSpace(pos);
+    if(peek(pos) == '}'){
+        return fail("Project has no frames");
+    }
+    while(true){
+        QByteArray key;
+        if(!readKey(pos, key) || !expect(pos, ':')){
+            return fail(QString("Malformed key at byte %1").arg(pos));
+        }
+        skipSpace(pos);
+        bool valueRead = false;
+        if(key == "frames"){
+            valueRead = parseFrames(pos);
+        }
+        else if(key == "durations"){
+            valueRead = parseDurations(pos);
+        }
+        else if(key == "width"){
+            valueRead = parseInt(pos, frameWidth);
+        }
+        else if(key == "height"){
+            valueRead = parseInt(pos, frameHeight);
+        }
+        else if(key == "numberOfFrames"){
+            valueRead = parseInt(pos, numberOfFrames);
+        }
+        else{
+            valueRead = skipValue(pos);
+        }
+        if(!valueRead){
+            return fail(QString("Malformed value for \"%1\"").arg(QString::fromUtf8(key)));
+        }
+        skipSpace(pos);
+        if(peek(pos) == ','){
+            pos++;
+            continue;
+        }
+        if(expect(pos, '}')){
+            break;
+        }
+        return fail(QString("Expected , or } at byte %1").arg(pos));
+    }
+
+    if(frameWidth <= 0 || frameHeight <= 0 || frameWidth > MAX_SIDE || frameHeight > MAX_SIDE){
+        return fail("Project size is missing or invalid");
+    }
+    numberOfFrames = qBound(0, numberOfFrames, MAX_FRAMES);
+    frameStarts.resize(numberOfFrames, -1);
+    return true;
+}
+
+/**
+ * @brief JsonProject::close
+ * Releases the mapping and the file
+ */
+void JsonProject::close()
+{
+    if(data != nullptr){
+        file.unmap(data);
+        data = nullptr;
+    }
+    file.close();
+    dataSize = 0;
+    frameWidth = 0;
+    frameHeight = 0;
+    numberOfFrames = 0;
+    frameStarts.clear();
+    durations.clear();
+}
+
+/**
+ * @brief JsonProject::fail
+ * Records the error and releases the file
+ * @param message
+ * @return
+ * always false so callers can return it directly
+ */
+bool JsonProject::fail(const QString &message)
+{
+    close();
+    error = message;
+    return false;
+}
+
+int JsonProject::width() const
+{
+    return frameWidth;
+}
+
+int JsonProject::height() const
+{
+    return frameHeight;
+}
+
+int JsonProject::frameCount() const
+{
+    return numberOfFrames;
+}
+
+/**
+ * @brief JsonProject::frameDurations
+ * @return
+ * The milliseconds each frame is shown for, 0 for frames the
+ * "durations" array leaves out
+ */
+vector<int> JsonProject::frameDurations() const
+{
+    vector<int> frameDurations = durations;
+    frameDurations.resize(numberOfFrames, 0);
+    return frameDurations;
+}
+
+QString JsonProject::errorString() const
+{
+    return error;
+}
+
+/**
+ * @brief JsonProject::parseFrames
+ * Walks the frames object and records the start of each
+ * "frameN" array without decoding its pixels
+ * @param pos
+ * Position of the opening brace, moved past the closing one
+ * @return
+ * true if the object is well formed
+ */
+bool JsonProject::parseFrames(qint64 &pos)
+{
+    if(!expect(pos, '{')){
+        return false;
+    }
+    skipSpace(pos);
+    if(peek(pos) == '}'){
+        pos++;
+        return true;
+    }
+    while(true){
+        QByteArray key;
+        if(!readKey(pos, key) || !expect(pos, ':')){
+            return false;
+        }
+        skipSpace(pos);
+        if(key.startsWith("frame")){
+            bool isNumber = false;
+            int index = key.mid(5).toInt(&isNumber);
+            if(isNumber && index >= 0 && index < MAX_FRAMES){
+                if(index >= static_cast<int>(frameStarts.size())){
+                    frameStarts.resize(index + 1, -1);
+                }
+                frameStarts[index] = pos;
+            }
+        }
+        if(!skipValue(pos)){
+            return false;
+        }
+        skipSpace(pos);
+        if(peek(pos) == ','){
+            pos++;
+            continue;
+        }
+        return expect(pos, '}');
+    }
+}
+
+/**
+ * @brief JsonProject::parseDurations
+ * Reads the array of frame durations, negative ones count as 0
+ * @param pos
+ * Position of the opening bracket, moved past the closing one
+ * @return
+ * true if the array is well formed
+ */
+bool JsonProject::parseDurations(qint64 &pos)
+{
+    durations.clear();
+    if(!expect(pos, '[')){
+        return false;
+    }
+    skipSpace(pos);
+    if(peek(pos) == ']'){
+        pos++;
+        return true;
+    }
+    while(true){
+        int duration = 0;
+        skipSpace(pos);
+        if(!parseInt(pos, duration)){
+            return false;
+        }
+        if(static_cast<int>(durations.size()) < MAX_FRAMES){
+            durations.push_back(qMax(0, duration));
+        }
+        skipSpace(pos);
+        if(peek(pos) == ','){
+            pos++;
+            continue;
+        }
+        return expect(pos, ']');
+    }
+}
+
+/**
+ * @brief JsonProject::frame
+ * Decodes one frame array straight into the image scanlines.
+ * Pixels missing from the file stay transparent, extra ones
+ * are ignored.
+ * @param index
+ * index of the frame in the project
+ * @return
+ * The frame as an ARGB32 image
+ */
+QImage JsonProject::frame(int index) const
+{
+    QImage image(frameWidth, frameHeight, QImage::Format_ARGB32);
+    image.fill(EMPTY_PIXEL);
+    if(index < 0 || index >= numberOfFrames || frameStarts[index] < 0){
+        return image;
+    }
+
+    qint64 pos = frameStarts[index];
+    if(!expect(pos, '[')){
+        return image;
+    }
+    skipSpace(pos);
+    if(peek(pos) == ']'){
+        return image;
+    }
+    for(int y = 0; ; y++){
+        if(!expect(pos, '[')){
+            return image;
+        }
+        QRgb *line = y < frameHeight ? reinterpret_cast<QRgb*>(image.scanLine(y)) : nullptr;
+        skipSpace(pos);
+        if(peek(pos) != ']'){
+            for(int x = 0; ; x++){
+                int channels[4] = {0, 0, 0, 0};
+                if(!expect(pos, '[')){
+                    return image;
+                }
+                for(int channel = 0; channel < 4; channel++){
+                    if(channel > 0 && !expect(pos, ',')){
+                        return image;
+                    }
+                    skipSpace(pos);
+                    if(!parseInt(pos, channels[channel])){
+                        return image;
+                    }
+                }
+                if(!expect(pos, ']')){
+                    return image;
+                }
+                if(line != nullptr && x < frameWidth){
+                    line[x] = qRgba(qBound(0, channels[0], 255), qBound(0, channels[1], 255),
+                                    qBound(0, channels[2], 255), qBound(0, channels[3], 255));
+                }
+                skipSpace(pos);
+                if(peek(pos) != ','){
+                    break;
+                }
+                pos++;
+            }
+        }
+        if(!expect(pos, ']')){
+            return image;
+        }
+        skipSpace(pos);
+        if(peek(pos) != ','){
+            break;
+        }
+        pos++;
+    }
+    return image;
+}
+
+/**
+ * @brief JsonProject::peek
+ * @return
+ * The byte at pos, or 0 past the end of the file
+ */
+char JsonProject::peek(qint64 pos) const
+{
+    return pos < dataSize ? static_cast<char>(data[pos]) : '\0';
+}
+
+/**
+ * @brief JsonProject::skipSpace
+ * Moves pos past any JSON whitespace
+ */
+void JsonProject::skipSpace(qint64 &pos) const
+{
+    while(pos < dataSize){
+        char c = static_cast<char>(data[pos]);
+        if(c != ' ' && c != '\n' && c != '\r' && c != '\t'){
+            return;
+        }
+        pos++;
+    }
+}
+
+/**
+ * @brief JsonProject::expect
+ * Skips whitespace and consumes the given character
+ * @return
+ * false if a different character was found
+ */
+bool JsonProject::expect(qint64 &pos, char c) const
+{
+    skipSpace(pos);
+    if(peek(pos) != c){
+        return false;
+    }
+    pos++;
+    return true;
+}
+
+/**
+ * @brief JsonProject::readKey
+ * Reads an object key, escapes are kept as written
+ */
+bool JsonProject::readKey(qint64 &pos, QByteArray &key) const
+{
+    skipSpace(pos);
+    qint64 start = pos + 1;
+    if(peek(pos) != '"' || !skipString(pos)){
+        return false;
+    }
+    key = QByteArray(reinterpret_cast<const char*>(data + start), pos - start - 1);
+    return true;
+}
+
+/**
+ * @brief JsonProject::skipString
+ * Moves pos from an opening quote past the closing quote
+ */
+bool JsonProject::skipString(qint64 &pos) const
+{
+    pos++;
+    while(pos < dataSize){
+        char c = static_cast<char>(data[pos]);
+        if(c == '\\'){
+            pos += 2;
+        }
+        else if(c == '"'){
+            pos++;
+            return true;
+        }
+        else{
+            pos++;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief JsonProject::parseInt
+ * Reads a JSON number, keeping only its integer part
+ */
+bool JsonProject::parseInt(qint64 &pos, int &value) const
+{
+    bool negative = peek(pos) == '-';
+    if(negative){
+        pos++;
+    }
+    qint64 result = 0;
+    qint64 start = pos;
+    while(peek(pos) >= '0' && peek(pos) <= '9'){
+        result = qMin<qint64>(result * 10 + (peek(pos) - '0'), INT_MAX);
+        pos++;
+    }
+    if(pos == start){
+        return false;
+    }
+    //fraction and exponent are not used by the format
+    while(peek(pos) == '.' || peek(pos) == 'e' || peek(pos) == 'E' || peek(pos) == '+'
+          || peek(pos) == '-' || (peek(pos) >= '0' && peek(pos) <= '9')){
+        pos++;
+    }
+    value = static_cast<int>(negative ? -result : result);
+    return true;
+}
+
+/**
+ * @brief JsonProject::skipValue
+ * Moves pos past any JSON value without decoding it
+ */
+bool JsonProject::skipValue(qint64 &pos) const
+{
+    skipSpace(pos);
+    char first = peek(pos);
+    if(first == '"'){
+        return skipString(pos);
+    }
+    if(first == '[' || first == '{'){
+        int depth = 0;
+        while(pos < dataSize){
+            char c = static_cast<char>(data[pos]);
+            if(c == '"'){
+                if(!skipString(pos)){
+                    return false;
+                }
+                continue;
+            }
+            if(c == '[' || c == '{'){
+                depth++;
+            }
+            else if(c == ']' || c == '}'){
+                depth--;
+                if(depth == 0){
+                    pos++;
+                    return true;
+                }
+            }
+            pos++;
+        }
+        return false;
+    }
+    qint64 start = pos;
+    while(pos < dataSize){
+        char c = static_cast<char>(data[pos]);
+        if(c == ',' || c == ']' || c == '}' || c == ' ' || c == '\n' || c == '\r' || c == '\t'){
+            break;
+        }
+        pos++;
+    }
+    return pos > start;
+}
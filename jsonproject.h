@@ -0,0 +1,70 @@
+#ifndef JSONPROJECT_H
+#define JSONPROJECT_H
+
+#include "projectreader.h"
+#include <QFile>
+#include <QImage>
+#include <QIODevice>
+#include <QString>
+#include <vector>
+
+using std::vector;
+
+/**
+ * JSON .ssp projects:
+ *
+ * {"durations": [ms, ...],
+ *  "frames": {"frame0": [[[r, g, b, a], ...], ...], ...},
+ *  "height": h, "numberOfFrames": n, "width": w}
+ *
+ * "durations" holds the milliseconds each frame is shown for.
+ * It is only written for projects with timing, and frames it
+ * leaves out are shown for 0 ms.
+ *
+ * Frames are written straight from the image scanlines and read
+ * straight into them, without building a QJsonDocument. The reader
+ * maps the file, records where each frame array starts and decodes
+ * a frame only when it is asked for.
+ */
+class JsonProject : public ProjectReader
+{
+public:
+    JsonProject();
+    ~JsonProject() override;
+
+    static QByteArray encodeFrame(const QImage&, bool);
+    static bool write(QIODevice*, const vector<QImage>&, bool, const vector<int>& = vector<int>());
+
+    bool open(const QString&) override;
+    void close() override;
+    int width() const override;
+    int height() const override;
+    int frameCount() const override;
+    QImage frame(int) const override;
+    vector<int> frameDurations() const override;
+    QString errorString() const override;
+
+private:
+    QFile file;
+    uchar *data = nullptr;
+    qint64 dataSize = 0;
+    int frameWidth = 0;
+    int frameHeight = 0;
+    int numberOfFrames = 0;
+    vector<qint64> frameStarts;
+    vector<int> durations;
+    QString error;
+
+    bool fail(const QString&);
+    bool parseFrames(qint64&);
+    bool parseDurations(qint64&);
+    bool parseInt(qint64&, int&) const;
+    bool skipValue(qint64&) const;
+    bool skipString(qint64&) const;
+    bool readKey(qint64&, QByteArray&) const;
+    void skipSpace(qint64&) const;
+    char peek(qint64) const;
+    bool expect(qint64&, char) const;
+};
+
+#endif // JSONPROJECT_H
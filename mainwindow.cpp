@@ -23,12 +23,13 @@ MainWindow::MainWindow(QWidget *parent)
     this->setWindowTitle("Sprite Editor");
 
     ui->deleteFrame->setEnabled(false);
-    ui->currentFrame->setPixmap(QPixmap::fromImage(model.frames[0]));
-    ui->currentFrame->setScaledContents(true);
+    ui->currentFrame->showFrame(model.frames[0], model.palette);
     //Initial Size
     ui->sizeBox->setCurrentIndex(1);
 
     createFileMenu();
+    createEditMenu();
+    createStatusBar();
 
     //Manage Frames
     connect(ui->addFrame, &QPushButton::clicked,
@@ -53,12 +54,22 @@ MainWindow::MainWindow(QWidget *parent)
             &model, &Model::setCurrentFrame);
     connect(ui->currentFrame, &DrawingUi::clicked,
             &model, &Model::pointClicked);
+    connect(ui->currentFrame, &DrawingUi::dragged,
+            &model, &Model::pointsDragged);
+    connect(ui->currentFrame, &DrawingUi::strokeStarted,
+            &model, &Model::beginStroke);
+    connect(ui->currentFrame, &DrawingUi::strokeFinished,
+            &model, &Model::endStroke);
     connect(&model, &Model::redraw,
            this, &MainWindow::updateView);
+    connect(&model, &Model::frameChanged,
+            this, &MainWindow::updateRegion);
     connect(&model, &Model::updateComboBox,
             ui->sizeBox, &QComboBox::setCurrentIndex);
     connect(&model, &Model::updateSpinBox,
             this, &MainWindow::updateSpinBox);
+    connect(&model, &Model::updateFrameCount,
+            this, &MainWindow::updateFrameCount);
 
     //only allows the user to draw when the pen is selected
     connect(this, &MainWindow::toolActive,
@@ -71,6 +82,10 @@ MainWindow::MainWindow(QWidget *parent)
             &model, &Model::setColor);
     connect(this, &MainWindow::eraserChecked,
             &model, &Model::setEraserActive);
+    connect(ui->bucket, &QPushButton::toggled,
+            this, &MainWindow::bucketToggled);
+    connect(this, &MainWindow::bucketChecked,
+            &model, &Model::setBucketActive);
 
     //Set up the connections for the stamps menu button
     //As well as the signals and slots that handle stamp
@@ -98,14 +113,40 @@ MainWindow::MainWindow(QWidget *parent)
             this, &MainWindow::setCurrentColor);
     connect(&colorSelection, &colorSelection::setColor,
             &model, &Model::setColor);
+    connect(&colorSelection, &colorSelection::replacePaletteColor,
+            &model, &Model::setPaletteColor);
+    connect(&model, &Model::updatePalette,
+            &colorSelection, &colorSelection::showPalette);
 
     //Sprite Preview
-    previewFrame = 0;
-    previewAnimation();
+    previewFrame = -1;
+    animationClock.setFrameRate(ui->fpsSlider->value());
+    animationClock.setFrameCount(model.frames.size());
+    connect(ui->fpsSlider, &QSlider::valueChanged,
+            &animationClock, &AnimationClock::setFrameRate);
+    //loads and new files reset the spin box, undo and redo keep
+    //its value, both change how many frames the clock plays
+    connect(&model, &Model::updateSpinBox,
+            &animationClock, &AnimationClock::setFrameCount);
+    connect(&model, &Model::updateFrameCount,
+            &animationClock, &AnimationClock::setFrameCount);
+    connect(&model, &Model::updateFrameDurations,
+            &animationClock, &AnimationClock::setFrameDurations);
+    connect(&animationClock, &AnimationClock::tick,
+            this, &MainWindow::previewAnimation);
+    connect(&animationClock, &AnimationClock::tick,
+            &spritePreview, &spritePreview::playFrame);
+    connect(&spritePreview, &spritePreview::visibilityChanged,
+            &animationClock, &AnimationClock::setViewerVisible);
     connect(ui->previewSprite, &QPushButton::clicked,
             this, &MainWindow::showSpritePreview);
     connect(this, &MainWindow::openSpritePreview,
             &spritePreview, &spritePreview::setSpriteWidth);
+    connect(this, &MainWindow::frameEdited,
+            &spritePreview, &spritePreview::frameEdited);
+
+    //after the connections so a recovered project reaches the views
+    model.startAutosave();
 }
 
 /**
@@ -130,6 +171,8 @@ void MainWindow::createFileMenu()
     open->setShortcut(QKeySequence::Open);
     save = new QAction(tr("Save"), this);
     save->setShortcut(QKeySequence::Save);
+    exportGif = new QAction(tr("Export GIF"), this);
+    exportAtlas = new QAction(tr("Export Atlas"), this);
 
     connect(newFile, &QAction::triggered,
             &model, &Model::newFile);
@@ -137,15 +180,167 @@ void MainWindow::createFileMenu()
             &model, &Model::openFile);
     connect(save, &QAction::triggered,
             &model, &Model::saveFile);
+    connect(exportGif, &QAction::triggered,
+            this, &MainWindow::exportAnimation);
+    connect(exportAtlas, &QAction::triggered,
+            &model, &Model::exportAtlas);
 
     fileMenu = new QMenu(tr("&File"), this);
     fileMenu->addAction(newFile);
     fileMenu->addAction(open);
     fileMenu->addAction(save);
+    fileMenu->addAction(exportGif);
+    fileMenu->addAction(exportAtlas);
 
     menuBar()->addMenu(fileMenu);
 }
 
+/**
+ * @brief MainWindow::createEditMenu
+ * Creates edit menu with undo and redo
+ */
+void MainWindow::createEditMenu()
+{
+    undo = new QAction(tr("Undo"), this);
+    undo->setShortcut(QKeySequence::Undo);
+    redo = new QAction(tr("Redo"), this);
+    redo->setShortcut(QKeySequence::Redo);
+    moveEarlier = new QAction(tr("Move Frame Earlier"), this);
+    moveEarlier->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_BracketLeft));
+    moveLater = new QAction(tr("Move Frame Later"), this);
+    moveLater->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_BracketRight));
+    resizeSprite = new QAction(tr("Resize Sprite..."), this);
+    indexedColors = new QAction(tr("Indexed Colors"), this);
+    indexedColors->setCheckable(true);
+    fillEverywhere = new QAction(tr("Bucket Fills Color Everywhere"), this);
+    fillEverywhere->setCheckable(true);
+    fillAllFrames = new QAction(tr("Bucket Fills All Frames"), this);
+    fillAllFrames->setCheckable(true);
+
+    connect(undo, &QAction::triggered,
+            &model, &Model::undo);
+    connect(redo, &QAction::triggered,
+            &model, &Model::redo);
+    connect(moveEarlier, &QAction::triggered,
+            this, &MainWindow::moveFrameEarlier);
+    connect(moveLater, &QAction::triggered,
+            this, &MainWindow::moveFrameLater);
+    connect(resizeSprite, &QAction::triggered,
+            &model, &Model::resizeSprite);
+    connect(indexedColors, &QAction::triggered,
+            &model, &Model::setIndexedMode);
+    connect(&model, &Model::updateIndexedMode,
+            indexedColors, &QAction::setChecked);
+    connect(fillEverywhere, &QAction::toggled,
+            &model, &Model::setBucketGlobal);
+    connect(fillAllFrames, &QAction::toggled,
+            &model, &Model::setBucketAllFrames);
+
+    editMenu = new QMenu(tr("&Edit"), this);
+    editMenu->addAction(undo);
+    editMenu->addAction(redo);
+    editMenu->addSeparator();
+    editMenu->addAction(moveEarlier);
+    editMenu->addAction(moveLater);
+    editMenu->addSeparator();
+    editMenu->addAction(resizeSprite);
+    editMenu->addAction(indexedColors);
+    editMenu->addSeparator();
+    editMenu->addAction(fillEverywhere);
+    editMenu->addAction(fillAllFrames);
+
+    menuBar()->addMenu(editMenu);
+}
+
+/**
+ * @brief MainWindow::createStatusBar
+ * Adds the progress of loads and saves to the status bar,
+ * with a button to cancel loads
+ */
+void MainWindow::createStatusBar()
+{
+    fileProgress = new QProgressBar(this);
+    fileProgress->setMaximumWidth(200);
+    fileProgress->setVisible(false);
+    cancelLoad = new QPushButton(tr("Cancel"), this);
+    cancelLoad->setVisible(false);
+
+    connect(cancelLoad, &QPushButton::clicked,
+            &model, &Model::cancelLoad);
+    connect(&model, &Model::loadingChanged,
+            this, &MainWindow::setLoading);
+    connect(&model, &Model::savingChanged,
+            this, &MainWindow::setSaving);
+    connect(&model, &Model::fileProgress,
+            this, &MainWindow::showFileProgress);
+    connect(&model, &Model::fileStatus, this, [this](const QString &message){
+        statusBar()->showMessage(message, 3000);
+    });
+
+    statusBar()->addPermanentWidget(fileProgress);
+    statusBar()->addPermanentWidget(cancelLoad);
+}
+
+/**
+ * @brief MainWindow::setLoading
+ * Editing is switched off while a file loads, since the frames
+ * are being replaced. The load can be canceled from the status bar.
+ * @param loading
+ */
+void MainWindow::setLoading(bool loading)
+{
+    loadingFile = loading;
+    ui->centralwidget->setEnabled(!loading);
+    editMenu->setEnabled(!loading);
+    newFile->setEnabled(!loading);
+    open->setEnabled(!loading);
+    save->setEnabled(!loading);
+    exportGif->setEnabled(!loading);
+    exportAtlas->setEnabled(!loading);
+    cancelLoad->setVisible(loading);
+    updateFileProgress();
+}
+
+/**
+ * @brief MainWindow::setSaving
+ * Saves run in the background, drawing goes on while they do
+ * @param saving
+ */
+void MainWindow::setSaving(bool saving)
+{
+    savingFile = saving;
+    updateFileProgress();
+}
+
+/**
+ * @brief MainWindow::showFileProgress
+ * @param done
+ * Frames read so far
+ * @param total
+ * Frames to read, 0 if the amount of work is not known
+ */
+void MainWindow::showFileProgress(int done, int total)
+{
+    fileProgress->setRange(0, total);
+    fileProgress->setValue(done);
+}
+
+/**
+ * @brief MainWindow::updateFileProgress
+ * Shows the progress bar while a load or a save is running
+ */
+void MainWindow::updateFileProgress()
+{
+    if(loadingFile || savingFile){
+        fileProgress->setFormat(loadingFile ? tr("Loading %p%") : tr("Saving"));
+        fileProgress->setVisible(true);
+    }
+    else{
+        fileProgress->setVisible(false);
+        fileProgress->reset();
+    }
+}
+
 /**
  * @brief MainWindow::showColorSelection
  * Shows the ColorSelection Window
@@ -172,8 +367,9 @@ void MainWindow::showStampSelection()
  */
 void MainWindow::addFrame()
 {
-    model.addFrame(ui->frameSpinBox->value(), DEFAULT_WIDTH, DEFAULT_WIDTH);
+    model.addFrame(ui->frameSpinBox->value());
     ui->frameSpinBox->setMaximum(model.frames.size());
+    animationClock.setFrameCount(model.frames.size());
     ui->frameSpinBox->setValue(ui->frameSpinBox->value() + 1);
 
     updateView();
@@ -191,6 +387,7 @@ void MainWindow::duplicateFrame()
 {
     model.duplicateFrame(ui->frameSpinBox->value());
     ui->frameSpinBox->setMaximum(model.frames.size());
+    animationClock.setFrameCount(model.frames.size());
     ui->frameSpinBox->setValue(ui->frameSpinBox->value() + 1);
 
     updateView();
@@ -210,6 +407,7 @@ void MainWindow::deleteFrame()
     model.deleteFrame(ui->frameSpinBox->value());
     ui->frameSpinBox->setValue(ui->frameSpinBox->value() - 1);
     ui->frameSpinBox->setMaximum(model.frames.size());
+    animationClock.setFrameCount(model.frames.size());
 
     updateView();
 
@@ -218,16 +416,46 @@ void MainWindow::deleteFrame()
     }
 }
 
+/**
+ * @brief MainWindow::moveFrameEarlier
+ * swaps the current frame with the one before it and
+ * keeps it selected
+ */
+void MainWindow::moveFrameEarlier()
+{
+    int index = ui->frameSpinBox->value() - 1;
+    if(index > 0){
+        model.moveFrame(index, index - 1);
+        ui->frameSpinBox->setValue(index);
+        updateView();
+    }
+}
+
+/**
+ * @brief MainWindow::moveFrameLater
+ * swaps the current frame with the one after it and
+ * keeps it selected
+ */
+void MainWindow::moveFrameLater()
+{
+    int index = ui->frameSpinBox->value() - 1;
+    if(index + 1 < (int)model.frames.size()){
+        model.moveFrame(index, index + 1);
+        ui->frameSpinBox->setValue(index + 2);
+        updateView();
+    }
+}
+
 /**
  * @brief MainWindow::updateFrame
- * Update the displayed image to QImage of frameNum index
+ * Update the displayed image to the frame at frameNum index
  * in frames vector
  * @param frameNum
- * index of QImage in frames vector
+ * index of the frame in the frames vector
  */
 void MainWindow::updateFrame(int frameNum)
 {
-    ui->currentFrame->setPixmap(QPixmap::fromImage(model.frames[frameNum - 1]));
+    ui->currentFrame->showFrame(model.frames[frameNum - 1], model.palette);
 }
 
 /**
@@ -249,10 +477,11 @@ void MainWindow::pencilToggled(bool selected)
         emit stampChecked(false);
         emit toolColor(currentColor);
         ui->eraser->setChecked(false);
+        ui->bucket->setChecked(false);
     }
 
-    //both tools are off
-    if(!(selected || ui->eraser->isChecked())){
+    //all tools are off
+    if(!(selected || ui->eraser->isChecked() || ui->bucket->isChecked())){
         emit toolActive(false);
     }
 }
@@ -274,9 +503,34 @@ void MainWindow::eraserToggled(bool selected)
         emit stampChecked(false);
         emit toolActive(true);
         ui->pencil->setChecked(false);
+        ui->bucket->setChecked(false);
 
     }
-    if(!(selected || ui->pencil->isChecked())){
+    if(!(selected || ui->pencil->isChecked() || ui->bucket->isChecked())){
+        emit toolActive(false);
+    }
+}
+
+/**
+ * @brief MainWindow::bucketToggled
+ * When checked clicks on the canvas fill with the current color
+ * Uncheck the other tools
+ * When unchecked look for other active tools
+ * @param selected
+ * The checked state of the button
+ */
+void MainWindow::bucketToggled(bool selected)
+{
+    emit bucketChecked(selected);
+    if(selected){
+        emit toolActive(true);
+        emit eraserChecked(false);
+        emit stampChecked(false);
+        emit toolColor(currentColor);
+        ui->pencil->setChecked(false);
+        ui->eraser->setChecked(false);
+    }
+    if(!(selected || ui->pencil->isChecked() || ui->eraser->isChecked())){
         emit toolActive(false);
     }
 }
@@ -296,6 +550,7 @@ void MainWindow::stampToggled(bool selected)
 
         ui->pencil->setChecked(false);
         ui->eraser->setChecked(false);
+        ui->bucket->setChecked(false);
     }
 }
 
@@ -342,7 +597,28 @@ QString MainWindow::getColorString()
  */
 void MainWindow::updateView()
 {
-    ui->currentFrame->setPixmap(QPixmap::fromImage(model.frames[ui->frameSpinBox->value() - 1]));
+    ui->currentFrame->showFrame(model.frames[ui->frameSpinBox->value() - 1], model.palette);
+    model.isSaved = false;
+}
+
+/**
+ * @brief MainWindow::updateRegion
+ * Shows the changed part of a frame in the UI, only the
+ * views currently showing that frame are redrawn
+ * @param frameIndex
+ * The frame that changed
+ * @param region
+ * The changed sprite pixels
+ */
+void MainWindow::updateRegion(int frameIndex, const QRect &region)
+{
+    if(frameIndex == ui->frameSpinBox->value() - 1){
+        ui->currentFrame->showRegion(model.frames[frameIndex], model.palette, region);
+    }
+    if(frameIndex == previewFrame){
+        ui->spritePreview->showRegion(model.frames[frameIndex], model.palette, region);
+    }
+    emit frameEdited(frameIndex, region);
     model.isSaved = false;
 }
 
@@ -365,20 +641,70 @@ void MainWindow::updateSpinBox(int max)
     }
 }
 
+/**
+ * @brief MainWindow::updateFrameCount
+ * slot for when undo or redo adds or removes frames,
+ * keeps the current frame where it is if it still exists
+ * @param count
+ * Number of frames in the sprite
+ */
+void MainWindow::updateFrameCount(int count)
+{
+    ui->frameSpinBox->setMaximum(count);
+    ui->deleteFrame->setEnabled(count > 1);
+}
+
 /**
  * @brief MainWindow::previewAnimation
- * Shows the next frame in order in the preview UI
+ * Shows the frame the animation clock is on in the preview UI
+ * @param frameIndex
+ * Frame to show
  */
-void MainWindow::previewAnimation()
+void MainWindow::previewAnimation(int frameIndex)
 {
-    if(previewFrame >= (int)model.frames.size()){
-        previewFrame = 0;
+    if(frameIndex >= (int)model.frames.size()){
+        return;
+    }
+    if(frameIndex < previewFrame){
+        ui->spritePreview->trimCache(model.frames.size());
     }
+    previewFrame = frameIndex;
+    ui->spritePreview->playFrame(previewFrame, model.frames[previewFrame], model.palette, model.frameGeneration(previewFrame));
+}
 
-    ui->spritePreview->setPixmap(QPixmap::fromImage(model.frames[previewFrame++]));
-    QTimer::singleShot(1000/ui->fpsSlider->value(),this, &MainWindow::previewAnimation);
+/**
+ * @brief MainWindow::exportAnimation
+ * Exports the frames as a GIF playing at the preview's frame rate
+ */
+void MainWindow::exportAnimation()
+{
+    model.exportGif(1000 / ui->fpsSlider->value());
 }
 
 void MainWindow::showSpritePreview(){
-    emit openSpritePreview(&model, 1000/ui->fpsSlider->value() );
+    emit openSpritePreview(&model);
+    spritePreview.playFrame(animationClock.frameIndex());
+}
+
+/**
+ * @brief MainWindow::showEvent
+ * The preview in the main window needs the animation clock
+ * while the window is shown
+ * @param event
+ */
+void MainWindow::showEvent(QShowEvent *event)
+{
+    QMainWindow::showEvent(event);
+    animationClock.setViewerVisible(true);
+}
+
+/**
+ * @brief MainWindow::hideEvent
+ * Stops driving the main window preview while it is hidden or minimized
+ * @param event
+ */
+void MainWindow::hideEvent(QHideEvent *event)
+{
+    QMainWindow::hideEvent(event);
+    animationClock.setViewerVisible(false);
 }
@@ -2,7 +2,9 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
-#include <QTimer>
+#include <QProgressBar>
+#include <QPushButton>
+#include "animationclock.h"
 #include "colorselection.h"
 #include "spritepreview.h"
 #include "model.h"
@@ -29,22 +31,31 @@ signals:
     void toolColor(QColor);
     void eraserChecked(bool);
     void stampChecked(bool);
-    void openSpritePreview(Model*, int);
+    void bucketChecked(bool);
+    void openSpritePreview(Model*);
+    void frameEdited(int, const QRect&);
 
 public slots:
     void setCurrentColor(QColor);
     void addFrame();
     void duplicateFrame();
     void deleteFrame();
+    void moveFrameEarlier();
+    void moveFrameLater();
     void updateFrame(int);
     void pencilToggled(bool);
     void eraserToggled(bool);
     void stampToggled(bool);
+    void bucketToggled(bool);
     void stampPlaced();
+    void setLoading(bool);
+    void setSaving(bool);
+    void showFileProgress(int, int);
 
 private:
     Ui::MainWindow *ui;
     colorSelection colorSelection;
+    AnimationClock animationClock;
     spritePreview spritePreview;
     QColor currentColor;
     int previewFrame;
@@ -52,18 +63,44 @@ private:
     QString getColorString();
     void showColorSelection();
     void showSpritePreview();
-    void previewAnimation();
+    void previewAnimation(int);
     void setActiveTool(bool, bool);
 
     void showStampSelection();
 
     void updateView();
+    void updateRegion(int, const QRect&);
     void updateSpinBox(int);
+    void updateFrameCount(int);
+
+    void showEvent(QShowEvent *) override;
+    void hideEvent(QHideEvent *) override;
 
     void createFileMenu();
     QMenu *fileMenu;
     QAction *newFile;
     QAction *save;
     QAction *open;
+    QAction *exportGif;
+    QAction *exportAtlas;
+    void exportAnimation();
+
+    void createEditMenu();
+    QMenu *editMenu;
+    QAction *undo;
+    QAction *redo;
+    QAction *indexedColors;
+    QAction *moveEarlier;
+    QAction *moveLater;
+    QAction *resizeSprite;
+    QAction *fillEverywhere;
+    QAction *fillAllFrames;
+
+    void createStatusBar();
+    void updateFileProgress();
+    QProgressBar *fileProgress;
+    QPushButton *cancelLoad;
+    bool loadingFile = false;
+    bool savingFile = false;
 };
 #endif // MAINWINDOW_H
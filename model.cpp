@@ -7,37 +7,593 @@
  */
 
 #include "model.h"
+#include "spritefile.h"
+#include "undohistory.h"
 #include <QObject>
 #include <QImage>
-#include <QMovie>
-#include<QJsonObject>
-#include <QJsonArray>
-#include <QJsonDocument>
 #include <QFileDialog>
 #include <QFileInfo>
+#include <QInputDialog>
 #include <QMessageBox>
-#include <QPainter>
+#include <QSet>
+#include <QStandardPaths>
+#include <QtConcurrent>
+#include <QtMath>
+#include <algorithm>
+#include <climits>
+
+//pixel memory the undo history may hold
+const qint64 UNDO_BUDGET_BYTES = 64 * 1024 * 1024;
+//colors an 8 bit index can address
+const int MAX_PALETTE_SIZE = 256;
+//scaled stamps kept before the cache starts over
+const int MAX_SCALED_STAMPS = 32;
+
+/**
+ * @brief byteMultiply
+ * Multiplies the four channels of a pixel by an alpha in 0..255,
+ * two channels per multiply
+ * @param pixel
+ * @param alpha
+ * @return
+ * The scaled pixel, each channel rounded
+ */
+static inline QRgb byteMultiply(QRgb pixel, uint alpha)
+{
+    quint32 redBlue = (pixel & 0xff00ff) * alpha;
+    redBlue = ((redBlue + ((redBlue >> 8) & 0xff00ff) + 0x800080) >> 8) & 0xff00ff;
+    quint32 alphaGreen = ((pixel >> 8) & 0xff00ff) * alpha;
+    alphaGreen = (alphaGreen + ((alphaGreen >> 8) & 0xff00ff) + 0x800080) & 0xff00ff00;
+    return alphaGreen | redBlue;
+}
+
+/**
+ * @brief sourceOver
+ * Draws a premultiplied pixel over a straight alpha one
+ * @param source
+ * Premultiplied stamp pixel
+ * @param destination
+ * Straight alpha frame pixel
+ * @return
+ * The straight alpha result
+ */
+static inline QRgb sourceOver(QRgb source, QRgb destination)
+{
+    const uint alpha = qAlpha(source);
+    if(alpha == 255){
+        return source;
+    }
+    return qUnpremultiply(source + byteMultiply(qPremultiply(destination), 255 - alpha));
+}
+
+/**
+ * @brief spanFill
+ * Scanline flood fill. Each seed taken off the stack is grown
+ * left and right into a span of the target value and filled,
+ * then the rows above and below the span get one seed per run
+ * of the target value. Pixels are read a few times at most and
+ * the stack holds runs rather than pixels. Spans cross tiles,
+ * only the tiles a span covers are copied to be filled.
+ * @param frame
+ * Frame whose pixels are of type Pixel
+ * @param seed
+ * @param target
+ * Value of the pixels being replaced
+ * @param fill
+ * @param beforeSpan
+ * Called with each span before it is filled
+ * @return
+ * The filled pixels' bounding rectangle
+ */
+template<typename Pixel>
+static QRect spanFill(TiledFrame &frame, QPoint seed, Pixel target, Pixel fill,
+                      const std::function<void(const QRect&)> &beforeSpan)
+{
+    const int width = frame.width();
+    const int height = frame.height();
+    QRect dirty;
+    vector<QPoint> seeds{seed};
+    while(!seeds.empty()){
+        const QPoint point = seeds.back();
+        seeds.pop_back();
+        if(frame.pixel<Pixel>(point.x(), point.y()) != target){
+            continue;
+        }
+        int left = point.x();
+        int right = point.x();
+        while(left > 0 && frame.pixel<Pixel>(left - 1, point.y()) == target){
+            left--;
+        }
+        while(right < width - 1 && frame.pixel<Pixel>(right + 1, point.y()) == target){
+            right++;
+        }
+        const QRect span(left, point.y(), right - left + 1, 1);
+        beforeSpan(span);
+        frame.fill(span, fill);
+        dirty |= span;
+
+        for(int y : {point.y() - 1, point.y() + 1}){
+            if(y < 0 || y >= height){
+                continue;
+            }
+            int x = left;
+            while(x <= right){
+                if(frame.pixel<Pixel>(x, y) != target){
+                    x++;
+                    continue;
+                }
+                seeds.push_back(QPoint(x, y));
+                while(x <= right && frame.pixel<Pixel>(x, y) == target){
+                    x++;
+                }
+            }
+        }
+    }
+    return dirty;
+}
+
+/**
+ * @brief replaceAll
+ * Replaces every pixel of the target value, one run at a time.
+ * Solid tiles of the target are replaced whole, so they stay
+ * solid and no tile is allocated for them.
+ * @param frame
+ * Frame whose pixels are of type Pixel
+ * @param target
+ * @param fill
+ * @param beforeSpan
+ * Called with each run before it is filled
+ * @return
+ * The filled pixels' bounding rectangle
+ */
+template<typename Pixel>
+static QRect replaceAll(TiledFrame &frame, Pixel target, Pixel fill,
+                        const std::function<void(const QRect&)> &beforeSpan)
+{
+    QRect dirty;
+    for(int tileY = 0; tileY < frame.height(); tileY += TiledFrame::TILE_SIZE){
+        for(int tileX = 0; tileX < frame.width(); tileX += TiledFrame::TILE_SIZE){
+            const QRect area = frame.tileRect(QPoint(tileX, tileY));
+            if(TiledFrame::isSolidTile(frame.tile(area.topLeft()))){
+                if(frame.pixel<Pixel>(tileX, tileY) == target){
+                    beforeSpan(area);
+                    frame.fill(area, fill);
+                    dirty |= area;
+                }
+                continue;
+            }
+            for(int y = area.top(); y <= area.bottom(); y++){
+                const Pixel *row = reinterpret_cast<const Pixel*>(frame.constScanLine(area.left(), y));
+                int x = 0;
+                while(x < area.width()){
+                    if(row[x] != target){
+                        x++;
+                        continue;
+                    }
+                    const int left = x;
+                    while(x < area.width() && row[x] == target){
+                        x++;
+                    }
+                    const QRect run(area.left() + left, y, x - left, 1);
+                    beforeSpan(run);
+                    frame.fill(run, fill);
+                    dirty |= run;
+                    //filling may have copied the tile
+                    row = reinterpret_cast<const Pixel*>(frame.constScanLine(area.left(), y));
+                }
+            }
+        }
+    }
+    return dirty;
+}
 
 /**
  * @brief Model::Model
  * Set the starting state of the program
  * Create an image for the user to draw on
- * Setting the pixel width changes the size of
- * the sprite
  * @param parent
  */
 Model::Model(QObject *parent)
-    : QObject{parent}
+    : QObject{parent}, history(frames, frameDurations, palette, UNDO_BUDGET_BYTES),
+      journal(frames, frameDurations, palette)
 {
-    QImage firstFrame(DEFAULT_WIDTH, DEFAULT_WIDTH, QImage::Format_ARGB32);
-    firstFrame.fill(transparentColor);
+    currentFrameIndex = 0;
+    spriteSize = QSize(32, 32);
+
+    frames.push_back(blankFrame(frameSize()));
+    frameDurations.push_back(0);
+
+    color.setRgb(0,0,0);
+
+    //files are read and written on their own thread, the worker
+    //reports back through queued signals
+    fileWorker = new FileWorker;
+    fileWorker->moveToThread(&fileThread);
+    connect(&fileThread, &QThread::finished,
+            fileWorker, &QObject::deleteLater);
+    connect(fileWorker, &FileWorker::progress,
+            this, &Model::fileProgress);
+    connect(fileWorker, &FileWorker::imageLoaded,
+            this, &Model::loadImage);
+    connect(fileWorker, &FileWorker::gifLoaded,
+            this, &Model::loadGif);
+    connect(fileWorker, &FileWorker::projectOpened,
+            this, &Model::startProject);
+    connect(fileWorker, &FileWorker::projectFramesLoaded,
+            this, &Model::showProjectFrames);
+    connect(fileWorker, &FileWorker::projectLoaded,
+            this, &Model::loadProject);
+    connect(fileWorker, &FileWorker::loadFailed,
+            this, &Model::showLoadError);
+    connect(fileWorker, &FileWorker::loadCanceled,
+            this, &Model::loadCanceled);
+    connect(fileWorker, &FileWorker::projectSaved,
+            this, &Model::projectSaved);
+    fileThread.start();
+}
 
-    frames.push_back(firstFrame.copy());
+/**
+ * @brief Model::~Model
+ * Stops a running load and waits for pending saves to finish
+ * before the file thread is shut down
+ */
+Model::~Model()
+{
+    fileWorker->setCanceled(true);
+    //quitting through the worker's queue lets saves asked for
+    //before it run to the end
+    QMetaObject::invokeMethod(fileWorker, [thread = &fileThread]{
+        thread->quit();
+    });
+    fileThread.wait();
+}
+
+/**
+ * @brief Model::startAutosave
+ * Starts journaling edits so they survive a crash. If the last
+ * session did not close cleanly, offers to bring its work back.
+ * Nothing is journaled when another editor owns the autosave.
+ */
+void Model::startAutosave()
+{
+    const QString directory = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation)
+            + "/autosave";
+    if(!journal.open(directory)){
+        return;
+    }
+    history.setJournal(&journal);
+    if(journal.hasRecovery()){
+        QMessageBox msgBox;
+        msgBox.setText("The editor did not close properly last time.");
+        msgBox.setInformativeText("Do you want to recover the unsaved work?");
+        msgBox.setStandardButtons(QMessageBox::Yes | QMessageBox::No);
+        msgBox.setDefaultButton(QMessageBox::Yes);
+        if(msgBox.exec() == QMessageBox::Yes){
+            recoverAutosave();
+        }
+    }
+    //clearing the history starts the journal from a snapshot
+    history.clear();
+}
 
+/**
+ * @brief Model::recoverAutosave
+ * Replaces the project with the one rebuilt from the journal
+ */
+void Model::recoverAutosave()
+{
+    vector<QImage> recoveredFrames;
+    vector<int> recoveredDurations;
+    QList<QRgb> recoveredPalette;
+    QString error;
+    if(!journal.recover(recoveredFrames, recoveredDurations, recoveredPalette, error)){
+        QMessageBox msgBox;
+        msgBox.setText(error);
+        msgBox.exec();
+        return;
+    }
+    frames = TiledFrame::fromImages(recoveredFrames);
+    frameDurations.swap(recoveredDurations);
+    palette = recoveredPalette;
+    spriteSize = frames.at(0).size();
     currentFrameIndex = 0;
-    pixelWidth = 16;
+    isSaved = false;
+    emit updatePalette(palette);
+    emit updateIndexedMode(isIndexed());
+    emit updateFrameDurations(frameDurations);
+    emit updateComboBox(sizeBoxIndex(spriteSize));
+    emit updateSpinBox(frames.size());
+    emit redraw();
+}
 
-    color.setRgb(0,0,0);
+/**
+ * @brief Model::frameSize
+ * Frames are stored at the logical sprite resolution,
+ * one image pixel per sprite pixel. The views scale them
+ * to whatever size they are shown at.
+ * @return
+ * The width and height of a frame in sprite pixels
+ */
+QSize Model::frameSize() const
+{
+    return spriteSize;
+}
+
+/**
+ * @brief Model::canvasScale
+ * @return
+ * Canvas pixels per sprite pixel when the sprite is fitted
+ * to the DEFAULT_WIDTH canvas, below 1 for large sprites
+ */
+double Model::canvasScale() const
+{
+    return DEFAULT_WIDTH / double(qMax(spriteSize.width(), spriteSize.height()));
+}
+
+/**
+ * @brief Model::frameGeneration
+ * Views use this to tell whether a frame changed since they
+ * last drew it. It is built from the frame's cache key, which
+ * changes whenever its tiles are written, so edits made through
+ * the undo history or a load are covered as well as drawing,
+ * and from the palette's generation, since a palette change
+ * recolors frames without writing to them.
+ * @param index
+ * Position of the frame
+ * @return
+ * A value that changes whenever the frame changes
+ */
+qint64 Model::frameGeneration(int index) const
+{
+    if(!isIndexed()){
+        return frames[index].cacheKey();
+    }
+    return qint64(qHashMulti(0, frames[index].cacheKey(), paletteGeneration));
+}
+
+/**
+ * @brief Model::isIndexed
+ * In indexed mode every frame is an 8 bit image of indices into
+ * the shared palette, otherwise frames hold ARGB pixels and the
+ * palette is empty
+ * @return
+ * true in indexed mode
+ */
+bool Model::isIndexed() const
+{
+    return !palette.isEmpty();
+}
+
+/**
+ * @brief Model::blankFrame
+ * Creates a transparent frame of the given logical size. Its
+ * tiles are all the shared transparent tile, so a blank frame
+ * costs no pixel memory whatever its size.
+ * @param size
+ * width and height of the frame in sprite pixels
+ * @return
+ * The new frame, indexed in indexed mode
+ */
+TiledFrame Model::blankFrame(const QSize &size)
+{
+    if(!isIndexed()){
+        return TiledFrame(size, QImage::Format_ARGB32, transparentColor.rgba());
+    }
+    return TiledFrame(size, QImage::Format_Indexed8, uint(paletteIndex(transparentColor.rgba())));
+}
+
+/**
+ * @brief Model::pixelValue
+ * @param rgba
+ * @return
+ * What a pixel of this color is stored as, the color itself
+ * in ARGB frames or its palette index in indexed frames
+ */
+QRgb Model::pixelValue(QRgb rgba)
+{
+    return isIndexed() ? QRgb(paletteIndex(rgba)) : rgba;
+}
+
+/**
+ * @brief Model::paletteIndex
+ * Finds a color in the palette. A color that is not in it yet
+ * is added while the palette has room, once it is full the
+ * closest color is used instead.
+ * @param rgba
+ * @return
+ * Index of the color in the palette
+ */
+int Model::paletteIndex(QRgb rgba)
+{
+    int index = palette.indexOf(rgba);
+    if(index >= 0){
+        return index;
+    }
+    if(palette.size() < MAX_PALETTE_SIZE){
+        QList<QRgb> colors = palette;
+        colors.append(rgba);
+        changePalette(colors);
+        return palette.size() - 1;
+    }
+    int closest = 0;
+    int closestDistance = INT_MAX;
+    for(int i = 0; i < palette.size(); i++){
+        int red = qRed(palette[i]) - qRed(rgba);
+        int green = qGreen(palette[i]) - qGreen(rgba);
+        int blue = qBlue(palette[i]) - qBlue(rgba);
+        int alpha = qAlpha(palette[i]) - qAlpha(rgba);
+        int distance = red * red + green * green + blue * blue + alpha * alpha;
+        if(distance < closestDistance){
+            closest = i;
+            closestDistance = distance;
+        }
+    }
+    return closest;
+}
+
+/**
+ * @brief Model::changePalette
+ * Replaces the palette as one undoable step. Frames keep their
+ * indices and are not touched, the palette is only given to
+ * them when they are made into images to be drawn or written.
+ * So this costs as much as the palette and not the pixels.
+ * @param colors
+ * The new palette, empty leaves indexed mode
+ */
+void Model::changePalette(const QList<QRgb> &colors)
+{
+    history.beginGroup();
+    history.recordPalette(palette, colors);
+    if(recolors(palette, colors)){
+        paletteGeneration++;
+    }
+    palette = colors;
+    history.endGroup();
+    emit updatePalette(palette);
+}
+
+/**
+ * @brief Model::recolors
+ * Colors added to or dropped from the end of the palette do
+ * not change how any frame looks, only changing a color both
+ * palettes have does
+ * @param before
+ * @param after
+ * @return
+ * true if frames may look different with the new palette
+ */
+bool Model::recolors(const QList<QRgb> &before, const QList<QRgb> &after)
+{
+    const qsizetype common = qMin(before.size(), after.size());
+    return !std::equal(before.cbegin(), before.cbegin() + common, after.cbegin());
+}
+
+/**
+ * @brief Model::indexedFrame
+ * Converts an image to indices into the palette, colors are
+ * looked up or added as paletteIndex does
+ * @param image
+ * @return
+ * The indexed frame
+ */
+QImage Model::indexedFrame(const QImage &image)
+{
+    if(image.format() == QImage::Format_Indexed8 && image.colorTable() == palette){
+        return image;
+    }
+    const QImage source = image.convertToFormat(QImage::Format_ARGB32);
+    QImage indexed(source.size(), QImage::Format_Indexed8);
+    //sprites use few colors, so each is only looked up once
+    QHash<QRgb, uchar> indices;
+    for(int y = 0; y < source.height(); y++){
+        const QRgb *line = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+        uchar *dest = indexed.scanLine(y);
+        for(int x = 0; x < source.width(); x++){
+            auto found = indices.constFind(line[x]);
+            if(found == indices.cend()){
+                found = indices.insert(line[x], uchar(paletteIndex(line[x])));
+            }
+            dest[x] = *found;
+        }
+    }
+    indexed.setColorTable(palette);
+    return indexed;
+}
+
+/**
+ * @brief Model::setIndexedMode
+ * Converts every frame to palette indices or back to ARGB as
+ * one undoable action. The palette is gathered from the colors
+ * the frames use, so a sprite with more than 256 colors
+ * cannot be indexed.
+ * @param indexed
+ * true to store frames as palette indices
+ */
+void Model::setIndexedMode(bool indexed)
+{
+    if(indexed == isIndexed()){
+        return;
+    }
+    if(!indexed){
+        vector<TiledFrame> converted = QtConcurrent::blockingMapped<vector<TiledFrame>>(frames,
+            [this](const TiledFrame &frame){
+                return TiledFrame(frame.toImage(palette).convertToFormat(QImage::Format_ARGB32));
+            });
+        history.beginGroup();
+        for(int i = 0; i < (int)frames.size(); i++){
+            frames[i].swap(converted[i]);
+            history.recordReplace(i, converted[i], frames[i]);
+        }
+        changePalette(QList<QRgb>());
+        history.endGroup();
+        emit updateIndexedMode(false);
+        emit redraw();
+        return;
+    }
+
+    //transparent comes first so blank pixels are index 0, tiles
+    //shared between frames or solid tiles are only read once
+    QList<QRgb> colors{transparentColor.rgba()};
+    QSet<QRgb> seen{transparentColor.rgba()};
+    QSet<qint64> readTiles;
+    for(const TiledFrame &frame : frames){
+        for(int tileY = 0; tileY < frame.height(); tileY += TiledFrame::TILE_SIZE){
+            for(int tileX = 0; tileX < frame.width(); tileX += TiledFrame::TILE_SIZE){
+                const QRect area = frame.tileRect(QPoint(tileX, tileY));
+                const qint64 tileKey = frame.tile(area.topLeft()).cacheKey();
+                if(readTiles.contains(tileKey)){
+                    continue;
+                }
+                readTiles.insert(tileKey);
+                for(int y = area.top(); y <= area.bottom(); y++){
+                    const QRgb *line = reinterpret_cast<const QRgb*>(frame.constScanLine(area.left(), y));
+                    for(int x = 0; x < area.width(); x++){
+                        if(!seen.contains(line[x])){
+                            seen.insert(line[x]);
+                            colors.append(line[x]);
+                        }
+                    }
+                }
+            }
+        }
+        if(colors.size() > MAX_PALETTE_SIZE){
+            QMessageBox msgBox;
+            msgBox.setText("The sprite uses more than 256 colors and cannot be indexed.");
+            msgBox.exec();
+            emit updateIndexedMode(false);
+            return;
+        }
+    }
+
+    history.beginGroup();
+    changePalette(colors);
+    for(int i = 0; i < (int)frames.size(); i++){
+        TiledFrame converted(indexedFrame(frames[i].toImage()));
+        frames[i].swap(converted);
+        history.recordReplace(i, converted, frames[i]);
+    }
+    history.endGroup();
+    emit updateIndexedMode(true);
+    emit redraw();
+}
+
+/**
+ * @brief Model::setPaletteColor
+ * Replaces one palette color, which recolors every pixel using
+ * it in every frame without touching the pixels themselves
+ * @param index
+ * Position of the color in the palette
+ * @param newColor
+ */
+void Model::setPaletteColor(int index, QColor newColor)
+{
+    if(index < 0 || index >= palette.size() || palette[index] == newColor.rgba()){
+        return;
+    }
+    QList<QRgb> colors = palette;
+    colors[index] = newColor.rgba();
+    changePalette(colors);
+    emit redraw();
 }
 
 /**
@@ -46,21 +602,22 @@ Model::Model(QObject *parent)
  * image added is a filled with a trasparent background
  * @param index
  * index where Image shoudld be added
- * @param width
- * @param height
  */
-void Model::addFrame(int index, int width, int height)
+void Model::addFrame(int index)
 {
-    QImage newFrame(width, height, QImage::Format_ARGB32);
-    newFrame.fill(transparentColor);
-
-    frames.insert(frames.begin() + index, newFrame.copy());
+    history.beginGroup();
+    frames.insert(frames.begin() + index, blankFrame(frameSize()));
+    frameDurations.insert(frameDurations.begin() + index, 0);
+    history.recordInsert(index, frames[index]);
+    history.endGroup();
+    emit updateFrameDurations(frameDurations);
 }
 
 /**
  * @brief Model::duplicateFrame
  * copy this frame and insert the copy into the next position
- * of the sprite
+ * of the sprite. The copy shares the frame's pixels until
+ * either of them is drawn on.
  * @param index
  * index to add duplicated frame after
  * retrieved from the frame spin box so
@@ -68,8 +625,12 @@ void Model::addFrame(int index, int width, int height)
  */
 void Model::duplicateFrame(int index)
 {
-    QImage newFrame(frames[index-1].copy());
-    frames.insert(frames.begin() + index, newFrame.copy());
+    history.beginGroup();
+    frames.insert(frames.begin() + index, frames[index-1]);
+    frameDurations.insert(frameDurations.begin() + index, frameDurations[index-1]);
+    history.recordInsert(index, frames[index]);
+    history.endGroup();
+    emit updateFrameDurations(frameDurations);
 }
 
 /**
@@ -83,7 +644,41 @@ void Model::duplicateFrame(int index)
  */
 void Model::deleteFrame(int index)
 {
+    history.beginGroup();
+    history.recordRemove(index - 1, frames[index - 1]);
     frames.erase(frames.begin() + (index - 1));
+    frameDurations.erase(frameDurations.begin() + (index - 1));
+    history.endGroup();
+    emit updateFrameDurations(frameDurations);
+}
+
+/**
+ * @brief Model::moveFrame
+ * Moves a frame to another position in the sprite. Frames
+ * are handles to their pixels, so only handles are moved.
+ * @param from
+ * index of the frame to move
+ * @param to
+ * index the frame ends up at
+ */
+void Model::moveFrame(int from, int to)
+{
+    const int count = frames.size();
+    if(from == to || from < 0 || to < 0 || from >= count || to >= count){
+        return;
+    }
+    history.beginGroup();
+    history.recordMove(from, to);
+    if(from < to){
+        std::rotate(frames.begin() + from, frames.begin() + from + 1, frames.begin() + to + 1);
+        std::rotate(frameDurations.begin() + from, frameDurations.begin() + from + 1, frameDurations.begin() + to + 1);
+    }
+    else{
+        std::rotate(frames.begin() + to, frames.begin() + from, frames.begin() + from + 1);
+        std::rotate(frameDurations.begin() + to, frameDurations.begin() + from, frameDurations.begin() + from + 1);
+    }
+    history.endGroup();
+    emit updateFrameDurations(frameDurations);
 }
 
 /**
@@ -126,14 +721,133 @@ void Model::setStampActive(bool active)
     stampActive = active;
 }
 
+/**
+ * @brief Model::setBucketActive
+ * While the bucket is active clicks fill instead of drawing
+ * @param active
+ */
+void Model::setBucketActive(bool active)
+{
+    bucketActive = active;
+}
+
+/**
+ * @brief Model::setBucketGlobal
+ * @param global
+ * true to replace the clicked color everywhere in the frame,
+ * false to fill only the area connected to the clicked pixel
+ */
+void Model::setBucketGlobal(bool global)
+{
+    bucketGlobal = global;
+}
+
+/**
+ * @brief Model::setBucketAllFrames
+ * @param allFrames
+ * true to fill at the clicked pixel in every frame
+ */
+void Model::setBucketAllFrames(bool allFrames)
+{
+    bucketAllFrames = allFrames;
+}
+
+/**
+ * @brief Model::bucketFill
+ * Fills the area of the clicked pixel's color with the pencil
+ * color. The current frame is filled in place, only the tiles
+ * the fill touches are recorded for undo. Filling every frame
+ * fills copies of the frames in parallel, each from its own
+ * color under the clicked pixel, and swaps in the changed ones.
+ * @param point
+ * The clicked sprite pixel
+ */
+void Model::bucketFill(QPoint point)
+{
+    if(!frames[currentFrameIndex].rect().contains(point)){
+        return;
+    }
+    history.beginGroup();
+    const QRgb pixel = pixelValue(color.rgba());
+    const bool global = bucketGlobal;
+    if(!bucketAllFrames){
+        const int frameIndex = currentFrameIndex;
+        QRect dirty = fillArea(frames[frameIndex], point, pixel, global, [this, frameIndex](const QRect &span){
+            history.recordTiles(frameIndex, span);
+        });
+        history.endGroup();
+        if(!dirty.isEmpty()){
+            emit frameChanged(frameIndex, dirty);
+        }
+        return;
+    }
+
+    //frames that are not filled keep sharing their tiles
+    vector<TiledFrame> filled = QtConcurrent::blockingMapped<vector<TiledFrame>>(frames,
+        [point, pixel, global](const TiledFrame &frame){
+            TiledFrame copy = frame;
+            fillArea(copy, point, pixel, global, [](const QRect&){});
+            return copy;
+        });
+    for(int i = 0; i < (int)frames.size(); i++){
+        if(filled[i].cacheKey() != frames[i].cacheKey()){
+            frames[i].swap(filled[i]);
+            history.recordReplace(i, filled[i], frames[i]);
+        }
+    }
+    history.endGroup();
+    emit redraw();
+}
+
+/**
+ * @brief Model::fillArea
+ * Bucket fills one frame. Only the tiles something is filled in
+ * stop sharing their pixels, and the frame only gets a new cache
+ * key if something is filled.
+ * @param frame
+ * ARGB32 or indexed frame
+ * @param seed
+ * The clicked sprite pixel
+ * @param pixel
+ * The fill color, a palette index for indexed frames
+ * @param global
+ * true to replace the seed's color everywhere
+ * @param beforeSpan
+ * Called with each run of pixels before it is filled
+ * @return
+ * The filled pixels' bounding rectangle
+ */
+QRect Model::fillArea(TiledFrame &frame, QPoint seed, QRgb pixel, bool global,
+                      const std::function<void(const QRect&)> &beforeSpan)
+{
+    if(frame.format() == QImage::Format_Indexed8){
+        const uchar target = frame.pixel<uchar>(seed.x(), seed.y());
+        if(target == uchar(pixel)){
+            return QRect();
+        }
+        return global ? replaceAll<uchar>(frame, target, uchar(pixel), beforeSpan)
+                      : spanFill<uchar>(frame, seed, target, uchar(pixel), beforeSpan);
+    }
+    const QRgb target = frame.pixel<QRgb>(seed.x(), seed.y());
+    if(target == pixel){
+        return QRect();
+    }
+    return global ? replaceAll<QRgb>(frame, target, pixel, beforeSpan)
+                  : spanFill<QRgb>(frame, seed, target, pixel, beforeSpan);
+}
+
 /**
  * @brief Model::clearCurrentFrame
- * Fills the current frame with a transparent background
+ * Fills the current frame with a transparent background, which
+ * gives back the memory of every tile that was drawn on
  */
 void Model::clearCurrentFrame()
 {
-    frames[currentFrameIndex].fill(transparentColor);
-    emit redraw();
+    history.beginGroup();
+    history.recordTiles(currentFrameIndex, frames[currentFrameIndex].rect());
+    frames[currentFrameIndex].fill(frames[currentFrameIndex].rect(), pixelValue(transparentColor.rgba()));
+    history.endGroup();
+    emit frameChanged(currentFrameIndex, frames[currentFrameIndex].rect());
 }
 
 /**
@@ -143,8 +857,11 @@ void Model::clearCurrentFrame()
  */
 void Model::fillFrame()
 {
-    frames[currentFrameIndex].fill(color);
-    emit redraw();
+    history.beginGroup();
+    history.recordTiles(currentFrameIndex, frames[currentFrameIndex].rect());
+    frames[currentFrameIndex].fill(frames[currentFrameIndex].rect(), pixelValue(color.rgba()));
+    history.endGroup();
+    emit frameChanged(currentFrameIndex, frames[currentFrameIndex].rect());
 }
 
 /**
@@ -154,7 +871,8 @@ void Model::fillFrame()
  * 1 is 32 pixels
  * 2 is 16 pixels
  * 3 is 8 pixels
- * default should never be reached
+ * -1 means the sprite has a size the box does not list,
+ * which leaves the sprite as it is
  * @param selectedSize
  * The changed index of the sizeBox
  */
@@ -162,77 +880,85 @@ void Model::setFrameSize(int selectedSize)
 {
     switch(selectedSize){
     case 0:
-        resizeFrames(8);
+        resizeFrames(QSize(64, 64));
         break;
     case 1:
-        resizeFrames(16);
+        resizeFrames(QSize(32, 32));
         break;
     case 2:
-        resizeFrames(32);
+        resizeFrames(QSize(16, 16));
         break;
     case 3:
-        resizeFrames(64);
+        resizeFrames(QSize(8, 8));
         break;
     default:
-        resizeFrames(16);
         break;
     }
 }
 
 /**
- * @brief Model::resizeFrames
- * Takes what is on the screen and changes the size to fit
- * the new pixel width. This copies the old frame and then
- * redraws all the pixels in the new position oriented to the
- * top left corner.
- * @param newPixelWidth
- * The pixel width changes the size of the image
+ * @brief Model::resizeSprite
+ * Asks for any width and height and resizes the sprite to it
  */
-void Model::resizeFrames(int newPixelWidth)
+void Model::resizeSprite()
 {
-    int oldFrameSize = DEFAULT_WIDTH / pixelWidth;
-    int newFrameSize = DEFAULT_WIDTH / newPixelWidth;
+    bool accepted = false;
+    QString text = QInputDialog::getText(nullptr, "Resize Sprite",
+                   QString("Width x height, at most %1 on a side:").arg(SpriteFile::MAX_SIDE),
+                   QLineEdit::Normal,
+                   QString("%1x%2").arg(spriteSize.width()).arg(spriteSize.height()), &accepted);
+    if(!accepted){
+        return;
+    }
+    QSize newSize = SpriteFile::parseSize(text);
+    if(!newSize.isValid()){
+        QMessageBox msgBox;
+        msgBox.setText("Not a supported sprite size: " + text);
+        msgBox.exec();
+        return;
+    }
+    resizeFrames(newSize);
+    emit updateComboBox(sizeBoxIndex(spriteSize));
+}
 
-    int smallerFrameSize = oldFrameSize;
-    if(newFrameSize < oldFrameSize){
-        smallerFrameSize = newFrameSize;
+/**
+ * @brief Model::resizeFrames
+ * Changes the sprite size. Each frame is replaced by a frame
+ * of the new size with the old pixels oriented to the top left
+ * corner, see TiledFrame::resized. Frames are resized in parallel.
+ * @param newSize
+ * The new width and height in sprite pixels
+ */
+void Model::resizeFrames(const QSize &newSize)
+{
+    if(newSize == spriteSize){
+        return;
     }
 
-    QImage tempImage(smallerFrameSize, smallerFrameSize, QImage::Format_ARGB32);
-    QColor originalColor = color;
+    history.beginGroup();
+    const QRgb padding = pixelValue(transparentColor.rgba());
+    vector<TiledFrame> resized = QtConcurrent::blockingMapped<vector<TiledFrame>>(frames,
+        [newSize, padding](const TiledFrame &frame){
+            return frame.resized(newSize, padding);
+        });
 
-    //convert all frames
     for(int i = 0; i < (int)frames.size(); i++){
-
-        //put this frames contents into temp image
-        for(int x = 0; x < tempImage.width(); x++){
-            for(int y = 0; y < tempImage.width(); y++){
-                tempImage.setPixelColor(x, y, frames[i].pixelColor(x * pixelWidth, y * pixelWidth));
-            }
-        }
-
-        frames[i].fill(transparentColor);
-
-        //fill in pixels from temp to new size
-        for(int x = 0; x < tempImage.width(); x++){
-            for(int y = 0; y < tempImage.width(); y++){
-                color = tempImage.pixelColor(x, y);
-                fillPixel(i, x * newPixelWidth, y * newPixelWidth, newPixelWidth);
-            }
-        }
+        frames[i].swap(resized[i]);
+        history.recordReplace(i, resized[i], frames[i]);
     }
-
-    color = originalColor;
-    pixelWidth = newPixelWidth;
+    history.recordSpriteSize(spriteSize, newSize);
+    history.endGroup();
+    spriteSize = newSize;
     emit redraw();
 }
 
 /**
  * @brief Model::pointClicked
- * Recieves the point on the label
+ * Recieves the sprite pixel
  * that was clicked by the user
  * If a stamp had previously been chosen
- * the stamp will be added at that point
+ * the stamp will be added at that point,
+ * with the bucket active the area is filled,
  * otherwise the pixel at that point is changed
  * @param point
  */
@@ -242,14 +968,112 @@ void Model::pointClicked(QPoint point)
     if(stampActive){
         addStamp(stampSelected, point);
     }
+    else if(bucketActive){
+        bucketFill(point);
+    }
     else{
-        int pixelX = point.x() / pixelWidth * pixelWidth;
-        int pixelY = point.y() / pixelWidth * pixelWidth;
-        fillPixel(currentFrameIndex, pixelX, pixelY, pixelWidth);
-        emit redraw();
+        history.beginGroup();
+        QRect dirty = strokeTo(point);
+        history.endGroup();
+        emit frameChanged(currentFrameIndex, dirty);
     }
 }
 
+/**
+ * @brief Model::pointsDragged
+ * Recieves the sprite pixels the mouse passed over since the last
+ * screen refresh while the user drags on the label. They are
+ * all drawn before the view is told to redraw once.
+ * Stamps and bucket fills only happen on the click that starts the drag.
+ * @param points
+ */
+void Model::pointsDragged(const QList<QPoint> &points)
+{
+    if(stampActive || bucketActive){
+        return;
+    }
+    QRect dirty;
+    history.beginGroup();
+    for(const QPoint &point : points){
+        dirty |= strokeTo(point);
+    }
+    history.endGroup();
+    if(!dirty.isEmpty()){
+        emit frameChanged(currentFrameIndex, dirty);
+    }
+}
+
+/**
+ * @brief Model::strokeTo
+ * Draws a line of sprite pixels from the last point of the
+ * stroke to this one, so fast mouse movement leaves no gaps.
+ * The first point of a stroke only draws its own pixel.
+ * @param pixel
+ * Sprite pixel under the mouse, it may be outside the frame
+ * @return
+ * Bounding box of the sprite pixels that were changed
+ */
+QRect Model::strokeTo(QPoint pixel)
+{
+    QPoint start = strokeHasPixel ? lastStrokePixel : pixel;
+    lastStrokePixel = pixel;
+    strokeHasPixel = true;
+
+    //Bresenham's line from start to pixel
+    QRect dirty;
+    int x = start.x();
+    int y = start.y();
+    int dx = qAbs(pixel.x() - x);
+    int dy = -qAbs(pixel.y() - y);
+    int stepX = x < pixel.x() ? 1 : -1;
+    int stepY = y < pixel.y() ? 1 : -1;
+    int error = dx + dy;
+    while(true){
+        dirty |= strokePixel(x, y);
+        if(x == pixel.x() && y == pixel.y()){
+            break;
+        }
+        int doubleError = 2 * error;
+        if(doubleError >= dy){
+            error += dy;
+            x += stepX;
+        }
+        if(doubleError <= dx){
+            error += dx;
+            y += stepY;
+        }
+    }
+    return dirty;
+}
+
+/**
+ * @brief Model::strokePixel
+ * Changes one sprite pixel of the current frame unless the
+ * current stroke already changed it
+ * @param x
+ * @param y
+ * @return
+ * The pixel if it was changed, otherwise an empty rectangle
+ */
+QRect Model::strokePixel(int x, int y)
+{
+    const TiledFrame &frame = frames[currentFrameIndex];
+    if(x < 0 || y < 0 || x >= frame.width() || y >= frame.height()){
+        return QRect();
+    }
+    int bit = y * frame.width() + x;
+    if(strokePainted.size() == frame.width() * frame.height()){
+        if(strokePainted.testBit(bit)){
+            return QRect();
+        }
+        strokePainted.setBit(bit);
+    }
+    QRect pixel(x, y, 1, 1);
+    history.recordTiles(currentFrameIndex, pixel);
+    fillPixel(currentFrameIndex, x, y);
+    return pixel;
+}
+
 /**
  * @brief Model::setColor
  * Changes the color to the user selected color unless
@@ -275,33 +1099,50 @@ void Model::setStamp(QImage stamp)
     stampSelected = stamp;
 }
 
+/**
+ * @brief Model::scaledStamp
+ * The stamp keeps the size it has on the canvas, so it is scaled
+ * by the canvas scale to the sprite resolution. Scaled stamps are
+ * kept per stamp and sprite size, premultiplied for blending,
+ * so placing the same stamp again does not scale it again.
+ * @param stamp
+ * @return
+ * The stamp at sprite resolution
+ */
+const QImage &Model::scaledStamp(const QImage &stamp)
+{
+    const double scale = canvasScale();
+    const QSize size(qMax(1, qRound(stamp.width() / scale)), qMax(1, qRound(stamp.height() / scale)));
+    const QPair<qint64, quint64> key(stamp.cacheKey(), (quint64(size.width()) << 32) | quint64(size.height()));
+    auto cached = scaledStamps.constFind(key);
+    if(cached == scaledStamps.cend()){
+        if(scaledStamps.size() >= MAX_SCALED_STAMPS){
+            scaledStamps.clear();
+        }
+        //nearest neighbour keeps the stamp's pixels hard edged
+        cached = scaledStamps.insert(key, stamp.scaled(size, Qt::IgnoreAspectRatio, Qt::FastTransformation)
+                                          .convertToFormat(QImage::Format_ARGB32_Premultiplied));
+    }
+    return *cached;
+}
+
 /**
  * @brief Model::fillPixel
- * Becuase the pixel width is how we change the size
- * of the sprite we need to fill extra pixels on the image
- * We add extra pixels with the for loops and make sure
- * they are in the range of the label size
+ * Sets one sprite pixel of the frame to the current color.
+ * Frames are stored at the logical resolution so a sprite
+ * pixel is a single frame pixel. Points outside the frame
+ * are ignored, and so are pixels that already have the color,
+ * so erasing empty space leaves its tiles shared.
  * @param frameIndex
  * The frame to draw on
  * @param x
- * The x position of the pixel
+ * The x position of the sprite pixel
  * @param y
- * The y position of the pixel
- * @param widthOfPixel
- * The current width of the pixel
- */
-void Model::fillPixel(int frameIndex, int x, int y, int widthOfPixel)
-{
-    for(int xExtraPixels = 0; xExtraPixels < widthOfPixel; xExtraPixels++){
-        for(int yExtraPixels = 0; yExtraPixels < widthOfPixel; yExtraPixels++){
-            int xPosition = x + xExtraPixels;
-            int yPosition = y + yExtraPixels;
-            bool xPositionInRange = xPosition >= 0 && xPosition < DEFAULT_WIDTH;
-            bool yPositionInRange = yPosition >= 0 && yPosition < DEFAULT_WIDTH;
-            if(xPositionInRange && yPositionInRange)
-                frames[frameIndex].setPixelColor(xPosition, yPosition, color);
-        }
-    }
+ * The y position of the sprite pixel
+ */
+void Model::fillPixel(int frameIndex, int x, int y)
+{
+    frames[frameIndex].fill(QRect(x, y, 1, 1), pixelValue(color.rgba()));
 }
 
 /**
@@ -336,12 +1177,8 @@ void Model::openFile()
     if(!fileName.isNull()){
         QFileInfo fileInfo(fileName);
         QString ext = fileInfo.suffix();
-        if(ext == "png" || ext == "jpg"){
-            loadImageFile(fileName);
-        }else if (ext == "ssp"){
-            loadProjectFile(fileName);
-        }else if(ext == "gif"){
-            loadGifFile(fileName);
+        if(ext == "png" || ext == "jpg" || ext == "ssp" || ext == "gif"){
+            startLoad(fileName);
         }else{
             QMessageBox msgBox;
             msgBox.setText("Selected file type is not supported.");
@@ -352,260 +1189,366 @@ void Model::openFile()
 }
 
 /**
- * @brief Model::loadImageFile
- * Method to load the image file to the project
- * and send signal to view to update project size
+ * @brief Model::startLoad
+ * Hands the file to the file thread. Editing is switched off
+ * until the load finishes, fails or is canceled.
  * @param fileName
  */
-void Model::loadImageFile(const QString &fileName)
+void Model::startLoad(const QString &fileName)
 {
-    QFile file(fileName);
-    file.open(QIODevice::ReadOnly);
-    QImage tempImage(DEFAULT_WIDTH, DEFAULT_WIDTH, QImage::Format_ARGB32);
-    tempImage.load(&file, nullptr);
-    emit updateComboBox(0);
-    QImage scaledImage = tempImage.scaled(DEFAULT_WIDTH, DEFAULT_WIDTH);
-    frames.at(0).swap(scaledImage);
-    emit redraw();
+    loading = true;
+    loadReplacedProject = false;
+    fileWorker->setCanceled(false);
+    emit loadingChanged(true);
+    QMetaObject::invokeMethod(fileWorker, [worker = fileWorker, fileName]{
+        worker->load(fileName);
+    });
 }
 
 /**
- * @brief Model::loadGifFile
- * Method to load the gif file to project.
- * uses QMovie to determin how many frames in the .gif file
- * and load each frame as QImage
- * @param fileName
+ * @brief Model::finishLoad
+ * Switches editing back on
  */
-void Model::loadGifFile(const QString &fileName)
+void Model::finishLoad()
 {
-    QMovie gif(fileName);
-    if(!gif.isValid()){
-        QMessageBox msgBox;
-        msgBox.setText("Invalid or unsupported GIF file.");
-        msgBox.exec();
-        return;
+    loading = false;
+    emit loadingChanged(false);
+}
+
+/**
+ * @brief Model::cancelLoad
+ * Asks the file thread to stop loading. The model is reset
+ * once the worker reports that it stopped.
+ */
+void Model::cancelLoad()
+{
+    if(loading){
+        fileWorker->setCanceled(true);
     }
-    emit updateComboBox(0);
-    for(int frameIndex = 0; frameIndex < gif.frameCount(); frameIndex++){
-        gif.jumpToFrame(frameIndex);
-        if(frameIndex == 0){
-            frames.at(0) = gif.currentImage().scaled(DEFAULT_WIDTH, DEFAULT_WIDTH);
-        }
-        else{
-            addFrame(frameIndex, DEFAULT_WIDTH, DEFAULT_WIDTH);
-            frames.at(frameIndex) = gif.currentImage().scaled(DEFAULT_WIDTH, DEFAULT_WIDTH);
-        }
-        gif.jumpToNextFrame();
+}
+
+/**
+ * @brief Model::showLoadError
+ * Shows why a file could not be loaded
+ * @param error
+ */
+void Model::showLoadError(const QString &error)
+{
+    finishLoad();
+    QMessageBox msgBox;
+    msgBox.setText(error);
+    msgBox.exec();
+}
+
+/**
+ * @brief Model::loadCanceled
+ * Images and GIFs are only added once fully read, so canceling
+ * them leaves the project as it was. A project being loaded has
+ * already replaced the old one and is dropped for a new file.
+ */
+void Model::loadCanceled()
+{
+    if(loadReplacedProject){
+        isSaved = true;
+        newFile();
+        emit updateComboBox(sizeBoxIndex(spriteSize));
+        emit redraw();
     }
-    emit updateSpinBox(frames.size());
-    emit redraw();
+    finishLoad();
+    emit fileStatus("Loading was canceled.");
 }
 
 /**
- * @brief Model::loadProjectFile
- * Method to read Jsonstring from the file selected by user.
- * if able to parse the Json, it will load the project and send signal to
- * view to update
- * @param fileName
- * QString contains the filepath
+ * @brief Model::loadImage
+ * Method to load an image read by the file thread to the project
+ * and send signal to view to update project size.
+ * The sprite takes the size of the image, images larger
+ * than a sprite can be are scaled down to fit.
+ * @param image
  */
-void Model::loadProjectFile(const QString &fileName)
+void Model::loadImage(const QImage &image)
 {
-    QFile file(fileName);
-    QColor currentColor = color;
-    if(file.open(QIODevice::ReadOnly | QIODevice::Text)){
-        QTextStream in(&file);
-        QString jsonString = in.readAll();
-        file.close();
+    history.beginGroup();
+    resizeFrames(image.size());
+    emit updateComboBox(sizeBoxIndex(spriteSize));
+    TiledFrame loaded(isIndexed() ? indexedFrame(image) : image);
+    frames.at(0).swap(loaded);
+    history.recordReplace(0, loaded, frames.at(0));
+    history.endGroup();
+    finishLoad();
+    emit redraw();
+}
 
-        QJsonParseError error;
-        QJsonDocument jsonDoc = QJsonDocument::fromJson(jsonString.toUtf8(), &error);
-        if(error.error != QJsonParseError::NoError){
-            QMessageBox msgBox;
-            msgBox.setText("Error Occued while parsing Json" + error.errorString());
-            msgBox.exec();
-            return;
-        }
-        else{
-            QJsonObject jsonData = jsonDoc.object();
-            loadFramesFromJson(jsonData);
-            color = currentColor;
-            emit redraw();
+/**
+ * @brief Model::loadGif
+ * Method to load a gif read by the file thread to project.
+ * The first frame of the gif replaces the current one
+ * and the rest are inserted after it in one go,
+ * each keeping the delay it had in the gif.
+ * The sprite takes the size of the gif.
+ * @param loaded
+ * @param delays
+ */
+void Model::loadGif(vector<QImage> loaded, const vector<int> &delays)
+{
+    history.beginGroup();
+    resizeFrames(loaded.at(0).size());
+    emit updateComboBox(sizeBoxIndex(spriteSize));
+    if(isIndexed()){
+        for(QImage &frame : loaded){
+            frame = indexedFrame(frame);
         }
     }
+    const vector<TiledFrame> tiled = TiledFrame::fromImages(loaded);
+    history.recordReplace(0, frames.at(0), tiled.at(0));
+    history.recordDuration(0, frameDurations.at(0), delays.at(0));
+    frames.at(0) = tiled.at(0);
+    frameDurations.at(0) = delays.at(0);
+
+    frames.insert(frames.begin() + 1, tiled.begin() + 1, tiled.end());
+    frameDurations.insert(frameDurations.begin() + 1, delays.begin() + 1, delays.end());
+    for(int frameIndex = 1; frameIndex < (int)tiled.size(); frameIndex++){
+        history.recordInsert(frameIndex, frames[frameIndex]);
+    }
+    history.endGroup();
+    finishLoad();
+    emit updateFrameDurations(frameDurations);
+    emit updateSpinBox(frames.size());
+    emit redraw();
 }
 
 /**
- * @brief Model::loadFramesFromJson
- * method to load the image from the JsonObject
- * converts the jsondocument to object and add number of frames needed in the project
- * Compatible size are : 4x4, 8x8, 16x16, 32x32, 64x64
- * @param jsonData
- * JsonData contains the project info
+ * @brief Model::startProject
+ * The file thread opened a project. The old project is replaced
+ * by blank frames of the project's size, which are filled in as
+ * the worker decodes them. The frames' durations come with the
+ * project, so they are known before any frame is decoded.
+ * @param size
+ * @param frameCount
+ * @param durations
+ * Milliseconds each frame is shown for, 0 without timing
  */
-void Model::loadFramesFromJson(const QJsonObject &jsonData)
+void Model::startProject(const QSize &size, int frameCount, const vector<int> &durations)
 {
-    int height = jsonData["height"].toInt();
-    int width = jsonData["width"].toInt();
-    int numberOfFrames = jsonData["numberOfFrames"].toInt();
-    QJsonObject framesOjbect = jsonData["frames"].toObject();
+    if(!prepareProject(size.width(), size.height())){
+        fileWorker->setCanceled(true);
+        return;
+    }
+    loadReplacedProject = true;
+    //the blank frames share their tiles until they are decoded
+    const TiledFrame blank = frames.at(0);
+    frames.resize(frameCount, blank);
+    frameDurations = durations;
+    frameDurations.resize(frames.size(), 0);
+    emit updateFrameDurations(frameDurations);
+    emit updateComboBox(sizeBoxIndex(spriteSize));
+    emit updateSpinBox(frames.size());
+    emit redraw();
+}
 
-    if(height != width){
-        QMessageBox msgBox;
-        msgBox.setText("Image must be square");
-        msgBox.exec();
+/**
+ * @brief Model::showProjectFrames
+ * Puts a batch of decoded frames in place and shows them
+ * @param first
+ * Index of the first frame in the batch
+ * @param decoded
+ */
+void Model::showProjectFrames(int first, const vector<QImage> &decoded)
+{
+    if(!loadReplacedProject || first + decoded.size() > frames.size()){
         return;
     }
-    int comboBoxIndex = 0;
-    switch(width){
-    case 4:
-        comboBoxIndex =3;
-        break;
-    case 8:
-        comboBoxIndex = 3;
-        break;
-    case 16:
-        comboBoxIndex = 2;
-        break;
-    case 32:
-        comboBoxIndex = 1;
-        break;
-    case 64:
-        comboBoxIndex = 0;
-        break;
-    default:
-        QMessageBox msgBox;
-        msgBox.setText("Unable to load image: Compatible sizes are: "
-                       "4x4, 8x8, 16x16, 32x32, 64x64");
-        msgBox.exec();
+    const vector<TiledFrame> tiled = TiledFrame::fromImages(decoded);
+    std::copy(tiled.begin(), tiled.end(), frames.begin() + first);
+    emit redraw();
+}
+
+/**
+ * @brief Model::loadProject
+ * Takes the project's frames once the file thread decoded all
+ * of them, with identical frames sharing their pixels
+ * @param decoded
+ */
+void Model::loadProject(const vector<QImage> &decoded)
+{
+    if(!loadReplacedProject || decoded.size() != frames.size()){
+        finishLoad();
         return;
     }
-    isSaved = true;
-    newFile();
-    pixelWidth = DEFAULT_WIDTH / width;
+    vector<QImage> images = decoded;
 
-    for(int frameIndex = 0; frameIndex < numberOfFrames; frameIndex++){
-        if(frameIndex == static_cast<int>(frames.size())){
-            addFrame(frameIndex, DEFAULT_WIDTH, DEFAULT_WIDTH);
+    //indexed projects decode to indexed frames that carry the palette
+    palette.clear();
+    for(const QImage &frame : images){
+        if(frame.format() == QImage::Format_Indexed8){
+            palette = frame.colorTable();
+            break;
         }
-        createImageFromJson(framesOjbect, frameIndex);
     }
-    emit updateComboBox(comboBoxIndex);
+    for(QImage &frame : images){
+        frame = isIndexed() ? indexedFrame(frame) : frame.convertToFormat(QImage::Format_ARGB32);
+    }
+    //mostly transparent frames only allocate the tiles drawn on
+    frames = TiledFrame::fromImages(images);
+    //matching damaged frames to the palette is part of the load
+    history.clear();
+    emit updatePalette(palette);
+    emit updateIndexedMode(isIndexed());
+    emit updateFrameDurations(frameDurations);
+    emit updateComboBox(sizeBoxIndex(spriteSize));
     emit updateSpinBox(frames.size());
+    finishLoad();
+    emit redraw();
 }
 
 /**
- * @brief Model::createImageFromJson
- * This method will convert the JsonObject that contains a frame information and
- * draw pixel based on the informaiton passed in by using fillPixel method
- * @param framesObject
- * JsonObject that contains frame infomraiton
- * @param frameIndex
- * Index of frame trying to convert to pixels
- */
-void Model::createImageFromJson(const QJsonObject &framesObject, int frameIndex)
-{
-    QString key = QString("frame%1").arg(frameIndex);
-    QJsonArray frameArray = framesObject[key].toArray();
-    for(int rowIndex = 0; rowIndex < frameArray.size(); rowIndex++){
-        QJsonArray row = frameArray[rowIndex].toArray();
-        for(int colIndex = 0; colIndex < row.size(); colIndex++){
-            QJsonArray rgba = row[colIndex].toArray();
-            QColor value(rgba[0].toInt(), rgba[1].toInt(), rgba[2].toInt(), rgba[3].toInt());
-            color = value;
-            fillPixel(frameIndex, colIndex * pixelWidth, rowIndex * pixelWidth, pixelWidth);
-        }
+ * @brief Model::prepareProject
+ * Checks that a project being loaded has a supported size,
+ * then resets the model to a single blank frame of that size
+ * @param width
+ * @param height
+ * @return
+ * false if the project cannot be loaded
+ */
+bool Model::prepareProject(int width, int height)
+{
+    QString error;
+    if(!SpriteFile::checkProjectSize(width, height, error)){
+        QMessageBox msgBox;
+        msgBox.setText(error);
+        msgBox.exec();
+        return false;
     }
+    isSaved = true;
+    newFile();
+    spriteSize = QSize(width, height);
+    frames.at(0) = blankFrame(frameSize());
+    return true;
 }
 
 /**
  * @brief Model::saveFile
  * This method is called when save menu is selected from the menu.
  * Write the .ssp file of current project informaiton.
+ * The binary format is the default, the JSON format is kept
+ * for exchanging projects with other tools and can be written
+ * indented or compact.
+ * The file is written on the file thread from a copy of the
+ * frames and their durations, the frames share their tiles
+ * until they are drawn on, so drawing can go on while the
+ * project is saved.
  */
 void Model::saveFile()
 {
-    QJsonObject jsonData = createJsonData();
-    QJsonDocument jsonDoc(jsonData);
-    QString jsonString = jsonDoc.toJson(QJsonDocument::Indented);
-    saveJsonToFile(jsonString);
+    const QString binaryFilter("Sprite sheet (*.ssp)");
+    const QString jsonFilter("Sprite sheet JSON (*.ssp)");
+    const QString compactJsonFilter("Sprite sheet compact JSON (*.ssp)");
+    QString selectedFilter;
+    QString filePath = QFileDialog::getSaveFileName(nullptr, "Save Project", "",
+                       binaryFilter + ";;" + jsonFilter + ";;" + compactJsonFilter,
+                       &selectedFilter);
+    if(filePath.isNull()){
+        return;
+    }
+
+    SpriteFile::ProjectFormat format = SpriteFile::Binary;
+    if(selectedFilter == jsonFilter){
+        format = SpriteFile::Json;
+    }
+    else if(selectedFilter == compactJsonFilter){
+        format = SpriteFile::CompactJson;
+    }
+    //edits made while the save runs mark the project unsaved again
+    isSaved = true;
+    if(pendingSaves++ == 0){
+        emit savingChanged(true);
+    }
+    //the frames are put together from their tiles on the file thread
+    QMetaObject::invokeMethod(fileWorker, [worker = fileWorker, filePath, snapshot = frames,
+                                           durations = frameDurations, colors = palette, format]{
+        worker->saveProject(filePath, TiledFrame::toImages(snapshot, colors), durations, format);
+    });
 }
 
 /**
- * @brief Model::createJsonData
- * Create JsonObject from frames vector contains QImage
- * @return
- * JsonObject contains height, width, number of frames, and each frame
- * infomration
+ * @brief Model::projectSaved
+ * Reports the result of a save from the file thread
+ * @param saved
+ * @param error
+ * The reason if the project could not be saved
  */
-QJsonObject Model::createJsonData()
+void Model::projectSaved(bool saved, const QString &error)
 {
-    QJsonObject jsonData;
-    int height = frames.at(0).height() / pixelWidth;
-    int width = frames.at(0).width() / pixelWidth;
-    int numberOfFrames = frames.size();
-    jsonData["height"] = height;
-    jsonData["width"] = width;
-    jsonData["numberOfFrames"] = numberOfFrames;
-    QJsonObject framesJson;
-    for(size_t index = 0; index < frames.size(); index++){
-        QJsonArray frame = createFrameArray(frames.at(index));
-        QString key = QString("frame%1").arg(index);
-        framesJson[key] = frame;
+    if(--pendingSaves == 0){
+        emit savingChanged(false);
+    }
+    if(saved){
+        emit fileStatus("Project has been saved.");
+        return;
     }
-    jsonData["frames"] = framesJson;
-    return jsonData;
+    isSaved = false;
+    QMessageBox msgBox;
+    msgBox.setText("Unable to save the project.");
+    msgBox.setInformativeText(error);
+    msgBox.exec();
 }
 
 /**
- * @brief Model::createFrameArray
- * Create JsonArray frame that contains 2D array of JsonArray
- * 2D array contains the RGBA color information of each pixel in rows
- * @param frameImage
- * @return
- * QJsonArray that contains a frame information
- */
-QJsonArray Model::createFrameArray(QImage &frameImage)
-{
-    QJsonArray frame;
-    for(int y = 0; y < frameImage.height() / pixelWidth; y++){
-        QJsonArray row;
-        for(int x = 0; x < frameImage.width() / pixelWidth; x++){
-            QRgb rgb = frameImage.pixel(x * pixelWidth, y * pixelWidth);
-            QJsonArray rgba;
-            rgba.append(qRed(rgb));
-            rgba.append(qGreen(rgb));
-            rgba.append(qBlue(rgb));
-            rgba.append(qAlpha(rgb));
-            row.append(rgba);
-        }
-        frame.append(row);
+ * @brief Model::exportGif
+ * Asks for a file name and writes the frames as an animated GIF
+ * @param frameDuration
+ * Milliseconds frames without their own duration are shown for
+ */
+void Model::exportGif(int frameDuration)
+{
+    QString filePath = QFileDialog::getSaveFileName(nullptr, "Export GIF", "",
+                       "Animated GIF (*.gif)");
+    if(filePath.isNull()){
+        return;
+    }
+
+    QString error;
+    QMessageBox msgBox;
+    const vector<QImage> colored = TiledFrame::toImages(frames, palette);
+    if(SpriteFile::writeGif(filePath, colored, frameDurations, frameDuration, error)){
+        msgBox.setText("GIF has been exported.");
     }
-    return frame;
+    else{
+        msgBox.setText(error);
+    }
+    msgBox.exec();
 }
 
 /**
- * @brief Model::saveJsonToFile
- * Function to write the Json string to text file.
- * Once text file is created it will display message to inform user
- * @param jsonString
- * JsonString converted from JsonDocument
+ * @brief Model::exportAtlas
+ * Asks for a file name and packs the frames into one atlas png,
+ * with an index of where each frame is written next to it
  */
-void Model::saveJsonToFile(const QString &jsonString)
+void Model::exportAtlas()
 {
-    QString filePath = QFileDialog::getSaveFileName(nullptr, "Save Project", "", "Sprite sheet (*.ssp)");
-    if(!filePath.isNull()){
-        QFile file(filePath);
-        if(file.open(QIODevice::WriteOnly | QIODevice::Text)){
-            QTextStream out(&file);
-            out << jsonString;
-            file.close();
-            isSaved = true;
-            QMessageBox msgBox;
-            msgBox.setText("Project has been saved.");
-            msgBox.exec();
-        }
+    const QString jsonFilter("Atlas with JSON index (*.png)");
+    const QString binaryFilter("Atlas with binary index (*.png)");
+    QString selectedFilter;
+    QString filePath = QFileDialog::getSaveFileName(nullptr, "Export Atlas", "",
+                       jsonFilter + ";;" + binaryFilter, &selectedFilter);
+    if(filePath.isNull()){
+        return;
+    }
+
+    AtlasWriter::Options options;
+    if(selectedFilter == binaryFilter){
+        options.indexFormat = AtlasWriter::BinaryIndex;
+    }
+    QString error;
+    QMessageBox msgBox;
+    const vector<QImage> colored = TiledFrame::toImages(frames, palette);
+    if(SpriteFile::writeAtlas(filePath, colored, frameDurations, options, error)){
+        msgBox.setText("Atlas has been exported.");
+    }
+    else{
+        msgBox.setText(error);
     }
+    msgBox.exec();
 }
 
 /**
@@ -633,30 +1576,185 @@ void Model::newFile(){
               break;
         }
     }
-    while(frames.size()!=1){
-        deleteFrame(frames.size()-1);
-    }
+    //every frame but the first is dropped in one go, there is
+    //nothing to record since the history is cleared below
+    frames.erase(frames.begin() + 1, frames.end());
+    frameDurations.assign(1, 0);
+    currentFrameIndex = 0;
+    emit updateFrameDurations(frameDurations);
     emit updateSpinBox(1);
     clearCurrentFrame();
+    history.clear();
 }
 
 /**
  * @brief Model::addStamp
- * Draws the stamp onto the current frame and redraws the frame.
+ * Blends the stamp onto the current frame in place and redraws
+ * the changed pixels. The stamp is scaled to the sprite
+ * resolution once and its corner sits on a sprite pixel, so
+ * its pixels line up with the frame's. Only the tiles the stamp
+ * draws on are copied, the undo history keeps the old ones.
  * Also, emits a signal to inform ui that the stamp has been placed.
  * @param stamp
  * The stamp being drawn.
  * @param point
- * The location where the stamp will be drawn.
+ * The sprite pixel where the stamp's top left corner goes.
  */
 void Model::addStamp(QImage stamp, QPoint point)
 {
-    QImage baseImg = frames.at(currentFrameIndex).copy();
-    QPainter painter(&baseImg);
+    const QImage &scaled = scaledStamp(stamp);
+    TiledFrame &frame = frames.at(currentFrameIndex);
+    const QRect target = QRect(point, scaled.size()).intersected(frame.rect());
+    if(target.isEmpty()){
+        emit stampPlaced();
+        return;
+    }
+    const QPoint offset = target.topLeft() - point;
 
-    painter.drawImage(point.x(), point.y(), stamp);
-    painter.end();
-    frames.at(currentFrameIndex).swap(baseImg);
-    emit redraw();
+    history.beginGroup();
+    history.recordTiles(currentFrameIndex, target);
+    const int tileSize = TiledFrame::TILE_SIZE;
+    for(int y = 0; y < target.height(); y++){
+        const QRgb *source = reinterpret_cast<const QRgb*>(scaled.constScanLine(offset.y() + y)) + offset.x();
+        const int row = target.top() + y;
+        if(frame.format() == QImage::Format_Indexed8){
+            //new colors may grow the palette, so each index is
+            //looked up before it is written
+            for(int x = 0; x < target.width(); x++){
+                if(qAlpha(source[x]) == 0){
+                    continue;
+                }
+                const int column = target.left() + x;
+                const QRgb blended = sourceOver(source[x], palette.value(frame.pixel<uchar>(column, row)));
+                *frame.scanLine(column, row) = uchar(paletteIndex(blended));
+            }
+            continue;
+        }
+        //the row is blended one tile at a time, a tile is only
+        //copied once the stamp has a pixel to draw on it
+        int x = 0;
+        while(x < target.width()){
+            const int column = target.left() + x;
+            const int run = qMin(target.width() - x, tileSize - column % tileSize);
+            QRgb *line = nullptr;
+            for(int i = 0; i < run; i++){
+                if(qAlpha(source[x + i]) == 0){
+                    continue;
+                }
+                if(!line){
+                    line = reinterpret_cast<QRgb*>(frame.scanLine(column, row));
+                }
+                line[i] = sourceOver(source[x + i], line[i]);
+            }
+            x += run;
+        }
+    }
+    history.endGroup();
+    emit frameChanged(currentFrameIndex, target);
     emit stampPlaced();
 }
+
+/**
+ * @brief Model::beginStroke
+ * Called when the user presses the mouse on the canvas, every
+ * pixel drawn until the mouse is released is undone together
+ * and is only drawn once
+ */
+void Model::beginStroke()
+{
+    history.beginGroup();
+    const TiledFrame &frame = frames[currentFrameIndex];
+    strokePainted.fill(false, frame.width() * frame.height());
+    strokeHasPixel = false;
+}
+
+/**
+ * @brief Model::endStroke
+ * Called when the user releases the mouse, closes the stroke
+ */
+void Model::endStroke()
+{
+    history.endGroup();
+    strokePainted.clear();
+    strokeHasPixel = false;
+}
+
+/**
+ * @brief Model::undo
+ * Reverts the last action the user took
+ */
+void Model::undo()
+{
+    QSize newSize = spriteSize;
+    const QList<QRgb> oldPalette = palette;
+    if(history.undo(newSize)){
+        historyApplied(newSize, oldPalette);
+    }
+}
+
+/**
+ * @brief Model::redo
+ * Applies the last undone action again
+ */
+void Model::redo()
+{
+    QSize newSize = spriteSize;
+    const QList<QRgb> oldPalette = palette;
+    if(history.redo(newSize)){
+        historyApplied(newSize, oldPalette);
+    }
+}
+
+/**
+ * @brief Model::historyApplied
+ * Brings the ui in line with the frames after an undo or redo
+ * @param newSize
+ * The size the frames now have
+ * @param oldPalette
+ * The palette before the history was applied
+ */
+void Model::historyApplied(const QSize &newSize, const QList<QRgb> &oldPalette)
+{
+    if(newSize != spriteSize){
+        //frames already have the restored size so set the size
+        //first, resizeFrames then ignores the size box change
+        spriteSize = newSize;
+        emit updateComboBox(sizeBoxIndex(spriteSize));
+    }
+    currentFrameIndex = qMin(currentFrameIndex, static_cast<int>(frames.size()) - 1);
+    if(recolors(oldPalette, palette)){
+        paletteGeneration++;
+    }
+    emit updatePalette(palette);
+    emit updateIndexedMode(isIndexed());
+    emit updateFrameCount(frames.size());
+    emit updateFrameDurations(frameDurations);
+    emit redraw();
+}
+
+/**
+ * @brief Model::sizeBoxIndex
+ * The reverse of setFrameSize
+ * @param size
+ * size of the sprite
+ * @return
+ * The size box index for the size or -1 if it has none
+ */
+int Model::sizeBoxIndex(const QSize &size) const
+{
+    if(size.width() != size.height()){
+        return -1;
+    }
+    switch(size.width()){
+    case 64:
+        return 0;
+    case 32:
+        return 1;
+    case 16:
+        return 2;
+    case 8:
+        return 3;
+    default:
+        return -1;
+    }
+}
@@ -4,9 +4,18 @@
 #include <QObject>
 #include <vector>
 #include <QImage>
-#include<QJsonObject>
-#include <QJsonArray>
+#include <QBitArray>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QThread>
+#include <functional>
+#include "fileworker.h"
+#include "journal.h"
+#include "tiledframe.h"
+#include "undohistory.h"
 
+//width and height of the canvas the sprite is shown on
 const int DEFAULT_WIDTH = 512;
 
 using std::vector;
@@ -16,54 +25,120 @@ class Model : public QObject
     Q_OBJECT
 public:
     explicit Model(QObject *parent = nullptr);
+    ~Model();
 
-    vector<QImage> frames;
+    vector<TiledFrame> frames;
+    vector<int> frameDurations;
+    QList<QRgb> palette;
     QColor color;
     int currentFrameIndex;
-    int pixelWidth;
+    QSize spriteSize;
     bool isSaved = true;
 
+    QSize frameSize() const;
+    double canvasScale() const;
+    qint64 frameGeneration(int) const;
+    bool isIndexed() const;
+    void startAutosave();
     void newFile();
     void openFile();
     void saveFile();
+    void exportGif(int);
+    void exportAtlas();
     void deleteFrame(int);
     void duplicateFrame(int);
-    void addFrame(int, int, int);
+    void addFrame(int);
+    void moveFrame(int, int);
 
 public slots:
     void fillFrame();
     void clearCurrentFrame();
     void setFrameSize(int);
+    void resizeSprite();
     void setCurrentFrame(int);
     void setStampActive(bool);
     void setEraserActive(bool);
+    void setBucketActive(bool);
+    void setBucketGlobal(bool);
+    void setBucketAllFrames(bool);
     void pointClicked(QPoint);
+    void pointsDragged(const QList<QPoint>&);
     void setColor(QColor);
+    void setIndexedMode(bool);
+    void setPaletteColor(int, QColor);
     void setStamp(QImage);
+    void beginStroke();
+    void endStroke();
+    void undo();
+    void redo();
+    void cancelLoad();
 
 signals:
     void redraw();
+    void frameChanged(int, const QRect&);
     void stampPlaced();
     void updateComboBox(int);
     void updateSpinBox(int);
+    void updateFrameCount(int);
+    void updateFrameDurations(const vector<int>&);
+    void updatePalette(const QList<QRgb>&);
+    void updateIndexedMode(bool);
+    void loadingChanged(bool);
+    void savingChanged(bool);
+    void fileProgress(int, int);
+    void fileStatus(const QString&);
 
 private:
+    friend class ModelBenchmark;
+
     bool eraserActive = false;
     bool stampActive = false;
+    bool bucketActive = false;
+    bool bucketGlobal = false;
+    bool bucketAllFrames = false;
     QImage stampSelected;
+    QHash<QPair<qint64, quint64>, QImage> scaledStamps;
+    quint32 paletteGeneration = 0;
     const QColor transparentColor = QColor(255, 255, 255, 0);
+    UndoHistory history;
+    Journal journal;
+    QBitArray strokePainted;
+    QPoint lastStrokePixel;
+    bool strokeHasPixel = false;
+    QThread fileThread;
+    FileWorker *fileWorker;
+    bool loading = false;
+    bool loadReplacedProject = false;
+    int pendingSaves = 0;
 
-    void fillPixel(int, int, int, int);
+    TiledFrame blankFrame(const QSize&);
+    QRgb pixelValue(QRgb);
+    int paletteIndex(QRgb);
+    void changePalette(const QList<QRgb>&);
+    static bool recolors(const QList<QRgb>&, const QList<QRgb>&);
+    QImage indexedFrame(const QImage&);
+    void fillPixel(int, int, int);
+    QRect strokeTo(QPoint);
+    QRect strokePixel(int, int);
     void addStamp(QImage, QPoint);
-    void loadImageFile(const QString&);
-    void loadGifFile(const QString&);
-    void loadProjectFile(const QString&);
-    void loadFramesFromJson(const QJsonObject&);
-    void createImageFromJson(const QJsonObject&,int);
-    void saveJsonToFile(const QString&);
-    QJsonObject createJsonData();
-    QJsonArray createFrameArray(QImage&);
-    void resizeFrames(int);
+    const QImage &scaledStamp(const QImage&);
+    void bucketFill(QPoint);
+    static QRect fillArea(TiledFrame&, QPoint, QRgb, bool, const std::function<void(const QRect&)>&);
+    void startLoad(const QString&);
+    void finishLoad();
+    void loadImage(const QImage&);
+    void loadGif(vector<QImage>, const vector<int>&);
+    void startProject(const QSize&, int, const vector<int>&);
+    void showProjectFrames(int, const vector<QImage>&);
+    void loadProject(const vector<QImage>&);
+    void showLoadError(const QString&);
+    void loadCanceled();
+    bool prepareProject(int, int);
+    void recoverAutosave();
+    void projectSaved(bool, const QString&);
+    void resizeFrames(const QSize&);
+    void historyApplied(const QSize&, const QList<QRgb>&);
+    int sizeBoxIndex(const QSize&) const;
 };
 
 #endif // MODEL_H
@@ -0,0 +1,34 @@
+#ifndef PROJECTREADER_H
+#define PROJECTREADER_H
+
+#include <QImage>
+#include <QString>
+#include <vector>
+
+using std::vector;
+
+/**
+ * Common interface of the .ssp readers so the model can load
+ * a project without caring which format it was saved in.
+ * frame() must be safe to call for different frames at once.
+ * It returns ARGB32 frames, or indexed frames carrying the
+ * palette for projects saved in indexed mode.
+ * frameDurations() gives the milliseconds each frame is shown
+ * for, 0 for frames of projects saved without timing.
+ */
+class ProjectReader
+{
+public:
+    virtual ~ProjectReader() = default;
+
+    virtual bool open(const QString&) = 0;
+    virtual void close() = 0;
+    virtual int width() const = 0;
+    virtual int height() const = 0;
+    virtual int frameCount() const = 0;
+    virtual QImage frame(int) const = 0;
+    virtual vector<int> frameDurations() const = 0;
+    virtual QString errorString() const = 0;
+};
+
+#endif // PROJECTREADER_H
@@ -0,0 +1,280 @@
+/**
+ * @brief Converts sprites between .ssp projects, images and GIFs
+ * without a display, for batch use in asset pipelines.
+ *
+ * spriteconv [options] <file or directory>...
+ * Directories are searched for .ssp, .png, .jpg and .gif files.
+ * Files are converted in parallel, one file per thread.
+ */
+
+#include "spritefile.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QHash>
+#include <QStringList>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <cstdio>
+
+struct Conversion {
+    QString input;
+    QString output;
+    QStringList outputs;
+    QString error;
+    bool converted = false;
+};
+
+/**
+ * @brief collectInputs
+ * Expands directories into the sprite files they contain
+ * @param paths
+ * Files and directories from the command line
+ * @param recursive
+ * Whether subdirectories are searched too
+ * @return
+ * The files to convert
+ */
+static QStringList collectInputs(const QStringList &paths, bool recursive)
+{
+    const QStringList filters = {"*.ssp", "*.png", "*.jpg", "*.gif"};
+    QStringList inputs;
+    for(const QString &path : paths){
+        QFileInfo info(path);
+        if(!info.isDir()){
+            inputs.append(path);
+            continue;
+        }
+        QDirIterator files(path, filters, QDir::Files,
+                           recursive ? QDirIterator::Subdirectories : QDirIterator::NoIteratorFlags);
+        QStringList found;
+        while(files.hasNext()){
+            found.append(files.next());
+        }
+        found.sort();
+        inputs.append(found);
+    }
+    return inputs;
+}
+
+/**
+ * @brief absolutePath
+ * @param path
+ * @return
+ * The path made absolute and clean, so two spellings of one
+ * file compare equal
+ */
+static QString absolutePath(const QString &path)
+{
+    return QDir::cleanPath(QFileInfo(path).absoluteFilePath());
+}
+
+/**
+ * @brief checkOutputs
+ * Outputs are named after their input without its suffix, so
+ * walk.png and walk.gif, or files of the same name in different
+ * directories written to one output directory, would write the
+ * same file at the same time. Frames written as images and
+ * atlas indexes add files of their own, walk.ssp writes
+ * walk_000.png and so on, which may be another conversion's
+ * input. Every file of every conversion is checked, and
+ * conversions that would write a file another one writes, or
+ * any input, are failed before anything is written.
+ * @param conversions
+ */
+static void checkOutputs(vector<Conversion> &conversions)
+{
+    QHash<QString, int> readers;
+    for(int i = 0; i < (int)conversions.size(); i++){
+        readers.insert(absolutePath(conversions[i].input), i);
+    }
+    QHash<QString, int> writers;
+    for(int i = 0; i < (int)conversions.size(); i++){
+        Conversion &conversion = conversions[i];
+        if(!conversion.error.isEmpty()){
+            continue;
+        }
+        for(const QString &output : conversion.outputs){
+            const QString path = absolutePath(output);
+            auto reader = readers.constFind(path);
+            if(reader != readers.cend()){
+                conversion.error = *reader == i
+                        ? "output would overwrite the input, use --output-dir or another format"
+                        : output + " would overwrite the input " + conversions[*reader].input;
+                break;
+            }
+            auto writer = writers.constFind(path);
+            if(writer == writers.cend()){
+                writers.insert(path, i);
+                continue;
+            }
+            Conversion &first = conversions[*writer];
+            conversion.error = output + " is also an output of " + first.input;
+            if(first.error.isEmpty()){
+                first.error = output + " is also an output of " + conversion.input;
+            }
+            break;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("spriteconv");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Converts sprite projects, images and GIFs.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("inputs", "Files or directories to convert.", "<input>...");
+    QCommandLineOption formatOption({"f", "format"},
+        "Output format: binary, json, compact-json, png, gif or atlas. Defaults to binary.", "format", "binary");
+    QCommandLineOption outputOption({"o", "output-dir"},
+        "Directory to write to. Defaults to the directory of each input.", "dir");
+    QCommandLineOption sizeOption({"s", "size"},
+        "Sprite size images and GIFs are scaled to, such as 32 or 256x128, "
+        "or original to keep their own size. Defaults to 32.", "size", "32");
+    QCommandLineOption jobsOption({"j", "jobs"},
+        "Files converted at the same time. Defaults to the number of cores.", "count");
+    QCommandLineOption durationOption({"d", "frame-duration"},
+        "Milliseconds per frame of exported GIFs, for inputs without their own timing. Defaults to 100.", "ms", "100");
+    QCommandLineOption gridOption("atlas-grid",
+        "Pack atlases on a grid instead of with MaxRects.");
+    QCommandLineOption untrimmedOption("atlas-untrimmed",
+        "Keep the transparent borders of frames in atlases.");
+    QCommandLineOption binaryIndexOption("atlas-binary-index",
+        "Write atlas indexes in the binary format instead of JSON.");
+    QCommandLineOption recursiveOption({"r", "recursive"},
+        "Search directories recursively.");
+    parser.addOptions({formatOption, outputOption, sizeOption, jobsOption, durationOption,
+                       gridOption, untrimmedOption, binaryIndexOption, recursiveOption});
+    parser.process(app);
+
+    const QString format = parser.value(formatOption);
+    QString suffix = "ssp";
+    SpriteFile::ProjectFormat projectFormat = SpriteFile::Binary;
+    if(format == "json"){
+        projectFormat = SpriteFile::Json;
+    }
+    else if(format == "compact-json"){
+        projectFormat = SpriteFile::CompactJson;
+    }
+    else if(format == "png" || format == "gif"){
+        suffix = format;
+    }
+    else if(format == "atlas"){
+        suffix = "png";
+    }
+    else if(format != "binary"){
+        std::fprintf(stderr, "spriteconv: unknown format %s\n", qPrintable(format));
+        return 2;
+    }
+
+    //an invalid size keeps the size of each image
+    const QString sizeText = parser.value(sizeOption);
+    const QSize frameSize = sizeText == "original" ? QSize() : SpriteFile::parseSize(sizeText);
+    if(sizeText != "original" && !frameSize.isValid()){
+        std::fprintf(stderr, "spriteconv: unsupported size %s\n", qPrintable(parser.value(sizeOption)));
+        return 2;
+    }
+
+    const int frameDuration = qMax(10, parser.value(durationOption).toInt());
+
+    AtlasWriter::Options atlasOptions;
+    atlasOptions.packing = parser.isSet(gridOption) ? AtlasWriter::Grid : AtlasWriter::MaxRects;
+    atlasOptions.trim = !parser.isSet(untrimmedOption);
+    atlasOptions.indexFormat = parser.isSet(binaryIndexOption) ? AtlasWriter::BinaryIndex : AtlasWriter::JsonIndex;
+
+    const QString outputDir = parser.value(outputOption);
+    if(!outputDir.isEmpty() && !QDir().mkpath(outputDir)){
+        std::fprintf(stderr, "spriteconv: cannot create %s\n", qPrintable(outputDir));
+        return 2;
+    }
+
+    const QStringList inputs = collectInputs(parser.positionalArguments(), parser.isSet(recursiveOption));
+    if(inputs.isEmpty()){
+        parser.showHelp(2);
+    }
+
+    vector<Conversion> conversions(inputs.size());
+    for(int i = 0; i < inputs.size(); i++){
+        QFileInfo info(inputs[i]);
+        QString dir = outputDir.isEmpty() ? info.path() : outputDir;
+        conversions[i].input = inputs[i];
+        conversions[i].output = dir + "/" + info.completeBaseName() + "." + suffix;
+    }
+
+    //files get their own pool so the frame level work inside
+    //each conversion keeps the global pool to itself
+    QThreadPool filePool;
+    if(parser.isSet(jobsOption)){
+        filePool.setMaxThreadCount(qMax(1, parser.value(jobsOption).toInt()));
+    }
+    const bool imageFrames = format == "png";
+    //image frames are written one file each, so the frames are
+    //counted to know the files before any is written
+    QtConcurrent::blockingMap(&filePool, conversions, [&](Conversion &conversion){
+        if(format == "atlas"){
+            conversion.outputs = {conversion.output,
+                                  AtlasWriter::indexFileName(conversion.output, atlasOptions.indexFormat)};
+        }
+        else if(imageFrames){
+            const int frameCount = SpriteFile::countFrames(conversion.input, conversion.error);
+            if(frameCount > 0){
+                conversion.outputs = SpriteFile::imagePaths(conversion.output, frameCount);
+            }
+        }
+        else{
+            conversion.outputs = {conversion.output};
+        }
+    });
+    checkOutputs(conversions);
+
+    QtConcurrent::blockingMap(&filePool, conversions, [&](Conversion &conversion){
+        if(!conversion.error.isEmpty()){
+            return;
+        }
+        vector<QImage> frames;
+        vector<int> durations;
+        if(!SpriteFile::read(conversion.input, frameSize, frames, conversion.error, &durations)){
+            return;
+        }
+        if(format == "atlas"){
+            conversion.converted = SpriteFile::writeAtlas(conversion.output, frames, durations,
+                                                          atlasOptions, conversion.error);
+        }
+        else if(imageFrames){
+            //only the files that were checked may be written
+            if(SpriteFile::imagePaths(conversion.output, frames.size()) != conversion.outputs){
+                conversion.error = "the input changed while it was converted";
+                return;
+            }
+            conversion.converted = SpriteFile::writeImages(conversion.output, frames, conversion.error);
+        }
+        else if(suffix == "gif"){
+            conversion.converted = SpriteFile::writeGif(conversion.output, frames, durations,
+                                                        frameDuration, conversion.error);
+        }
+        else{
+            conversion.converted = SpriteFile::writeProject(conversion.output, frames, durations,
+                                                            projectFormat, conversion.error);
+        }
+    });
+
+    int failed = 0;
+    for(const Conversion &conversion : conversions){
+        if(conversion.converted){
+            const QString written = conversion.outputs.size() > 1 && imageFrames
+                    ? conversion.outputs.first() + " ... " + conversion.outputs.last()
+                    : conversion.output;
+            std::printf("%s -> %s\n", qPrintable(conversion.input), qPrintable(written));
+        }
+        else{
+            std::fprintf(stderr, "%s: %s\n", qPrintable(conversion.input), qPrintable(conversion.error));
+            failed++;
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,20 @@
+# Command line converter, runs without a display:
+#   qmake spriteconv.pro && make
+#   ./spriteconv --format png --output-dir out sprites/
+
+QT       -= widgets
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = spriteconv
+
+include(spritecore.pri)
+
+SOURCES += \
+    spriteconv.cpp
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
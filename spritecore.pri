@@ -0,0 +1,21 @@
+# Loading and saving sprites, shared by the editor and spriteconv.
+# Nothing listed here may depend on QtWidgets.
+
+QT += core gui concurrent
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/atlaswriter.cpp \
+    $$PWD/binaryproject.cpp \
+    $$PWD/gifwriter.cpp \
+    $$PWD/jsonproject.cpp \
+    $$PWD/spritefile.cpp
+
+HEADERS += \
+    $$PWD/atlaswriter.h \
+    $$PWD/binaryproject.h \
+    $$PWD/gifwriter.h \
+    $$PWD/jsonproject.h \
+    $$PWD/projectreader.h \
+    $$PWD/spritefile.h
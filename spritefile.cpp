@@ -0,0 +1,616 @@
+/**
+ * @brief Loads and saves projects, images and GIFs with no
+ * dependency on widgets, shared by the editor and spriteconv.
+ */
+
+#include "spritefile.h"
+#include "binaryproject.h"
+#include "gifwriter.h"
+#include "jsonproject.h"
+#include <QBuffer>
+#include <QFileInfo>
+#include <QHash>
+#include <QImageReader>
+#include <QSaveFile>
+#include <QtConcurrent>
+#include <numeric>
+
+//the color of pixels nothing has been drawn on
+const QRgb TRANSPARENT_PIXEL = qRgba(255, 255, 255, 0);
+
+/**
+ * @brief SpriteFile::blankFrame
+ * @param size
+ * width and height of the frame in sprite pixels
+ * @return
+ * A transparent ARGB32 frame
+ */
+QImage SpriteFile::blankFrame(const QSize &size)
+{
+    QImage frame(size, QImage::Format_ARGB32);
+    frame.fill(TRANSPARENT_PIXEL);
+    return frame;
+}
+
+/**
+ * @brief SpriteFile::downsample
+ * Scales an image to a sprite frame by picking the source
+ * pixel under the centre of each sprite pixel. The source
+ * column of every sprite column is worked out once, each row
+ * is then a gather from one source scanline. An image that
+ * already has the frame's size is only converted to ARGB32.
+ * @param image
+ * @param size
+ * width and height of the frame in sprite pixels
+ * @return
+ * The ARGB32 frame
+ */
+QImage SpriteFile::downsample(const QImage &image, const QSize &size)
+{
+    const QImage source = image.format() == QImage::Format_ARGB32
+            ? image : image.convertToFormat(QImage::Format_ARGB32);
+    if(source.size() == size){
+        return source;
+    }
+    QImage frame(size, QImage::Format_ARGB32);
+    if(source.isNull()){
+        frame.fill(TRANSPARENT_PIXEL);
+        return frame;
+    }
+    const int width = size.width();
+    const int height = size.height();
+    vector<int> columns(width);
+    for(int x = 0; x < width; x++){
+        columns[x] = int((2 * qint64(x) + 1) * source.width() / (2 * width));
+    }
+    for(int y = 0; y < height; y++){
+        int sourceY = int((2 * qint64(y) + 1) * source.height() / (2 * height));
+        const QRgb *sourceLine = reinterpret_cast<const QRgb*>(source.constScanLine(sourceY));
+        QRgb *line = reinterpret_cast<QRgb*>(frame.scanLine(y));
+        for(int x = 0; x < width; x++){
+            line[x] = sourceLine[columns[x]];
+        }
+    }
+    return frame;
+}
+
+/**
+ * @brief SpriteFile::fittedSize
+ * @param size
+ * Size of an image
+ * @return
+ * The image's own size if it is a supported sprite size,
+ * otherwise the size scaled down to fit, keeping its shape
+ */
+QSize SpriteFile::fittedSize(const QSize &size)
+{
+    if(size.isEmpty() || isSupportedSize(size)){
+        return size;
+    }
+    return size.scaled(MAX_SIDE, MAX_SIDE, Qt::KeepAspectRatio).expandedTo(QSize(1, 1));
+}
+
+/**
+ * @brief SpriteFile::parseSize
+ * @param text
+ * A side length such as 32 or a width and height such as 256x128
+ * @return
+ * The size, or an invalid size if the text is not a supported size
+ */
+QSize SpriteFile::parseSize(const QString &text)
+{
+    const QStringList sides = text.trimmed().toLower().split('x');
+    bool widthIsNumber = false;
+    bool heightIsNumber = true;
+    int width = sides.at(0).trimmed().toInt(&widthIsNumber);
+    int height = sides.size() == 2 ? sides.at(1).trimmed().toInt(&heightIsNumber) : width;
+    QSize size(width, height);
+    if(sides.size() > 2 || !widthIsNumber || !heightIsNumber || !isSupportedSize(size)){
+        return QSize();
+    }
+    return size;
+}
+
+/**
+ * @brief SpriteFile::isSupportedSize
+ * @param size
+ * width and height of a frame in sprite pixels
+ * @return
+ * true for the sprite sizes the editor can show, any
+ * shape up to MAX_SIDE pixels on a side
+ */
+bool SpriteFile::isSupportedSize(const QSize &size)
+{
+    return size.width() >= 1 && size.height() >= 1
+            && size.width() <= MAX_SIDE && size.height() <= MAX_SIDE;
+}
+
+/**
+ * @brief SpriteFile::checkProjectSize
+ * Sprites can have any width and height up to MAX_SIDE
+ * @param width
+ * @param height
+ * @param error
+ * Set to the reason if the size is not supported
+ * @return
+ * true if a project of this size can be loaded
+ */
+bool SpriteFile::checkProjectSize(int width, int height, QString &error)
+{
+    if(!isSupportedSize(QSize(width, height))){
+        error = QString("Unable to load image: sprites can be at most %1 pixels on a side").arg(MAX_SIDE);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief frameHash
+ * @param frame
+ * @return
+ * A hash of the frame's size, format and pixels
+ */
+static size_t frameHash(const QImage &frame)
+{
+    const qsizetype rowBytes = qsizetype(frame.width()) * frame.depth() / 8;
+    size_t hash = qHashMulti(0, frame.width(), frame.height(), int(frame.format()));
+    for(int y = 0; y < frame.height(); y++){
+        hash = qHashBits(frame.constScanLine(y), rowBytes, hash);
+    }
+    return hash;
+}
+
+/**
+ * @brief SpriteFile::shareDuplicateFrames
+ * Makes identical frames share one pixel buffer. Frames are
+ * hashed in parallel and frames with the same hash are compared
+ * pixel by pixel before they are shared. Editing a shared frame
+ * later gives it its own copy again.
+ * @param frames
+ * @return
+ * The number of frames that now share an earlier frame's pixels
+ */
+int SpriteFile::shareDuplicateFrames(vector<QImage> &frames)
+{
+    if(frames.size() < 2){
+        return 0;
+    }
+    const vector<size_t> hashes = QtConcurrent::blockingMapped<vector<size_t>>(frames, frameHash);
+    QHash<size_t, vector<int>> seen;
+    int shared = 0;
+    for(int frameIndex = 0; frameIndex < (int)frames.size(); frameIndex++){
+        vector<int> &candidates = seen[hashes[frameIndex]];
+        bool matched = false;
+        for(int candidate : candidates){
+            if(frames[candidate] == frames[frameIndex]){
+                frames[frameIndex] = frames[candidate];
+                matched = true;
+                shared++;
+                break;
+            }
+        }
+        if(!matched){
+            candidates.push_back(frameIndex);
+        }
+    }
+    return shared;
+}
+
+/**
+ * @brief SpriteFile::openProject
+ * Opens a .ssp project. Binary projects are recognised by their
+ * header, anything else is read as a JSON project.
+ * @param fileName
+ * @param error
+ * Set to the reason if the project cannot be opened
+ * @return
+ * A reader with the project open, or null
+ */
+std::unique_ptr<ProjectReader> SpriteFile::openProject(const QString &fileName, QString &error)
+{
+    std::unique_ptr<ProjectReader> project;
+    if(BinaryProject::isBinaryProject(fileName)){
+        project = std::make_unique<BinaryProject>();
+    }
+    else{
+        project = std::make_unique<JsonProject>();
+    }
+    if(!project->open(fileName)){
+        error = "Unable to open project: " + project->errorString();
+        return nullptr;
+    }
+    return project;
+}
+
+/**
+ * @brief SpriteFile::decodeFrames
+ * Decodes the frames of an open project in parallel straight
+ * into their place in the vector. Frames that cannot be
+ * decoded are left blank. Identical frames end up sharing
+ * their pixels.
+ * @param project
+ * Reader with the project open
+ * @param frames
+ * Resized to the project's frame count
+ * @param firstFrame
+ * Frames before this one are left as they are, so a caller
+ * can decode and show the first frame on its own
+ */
+void SpriteFile::decodeFrames(const ProjectReader &project, vector<QImage> &frames, int firstFrame)
+{
+    frames.resize(project.frameCount());
+    decodeFrameRange(project, frames, firstFrame, project.frameCount());
+    shareDuplicateFrames(frames);
+}
+
+/**
+ * @brief SpriteFile::decodeFrameRange
+ * Decodes some of the frames of an open project in parallel.
+ * Frames that cannot be decoded are left blank.
+ * @param project
+ * Reader with the project open
+ * @param frames
+ * Already sized to the project's frame count
+ * @param firstFrame
+ * @param endFrame
+ * One past the last frame decoded
+ */
+void SpriteFile::decodeFrameRange(const ProjectReader &project, vector<QImage> &frames,
+                                  int firstFrame, int endFrame)
+{
+    if(firstFrame >= endFrame){
+        return;
+    }
+    vector<int> range(endFrame - firstFrame);
+    std::iota(range.begin(), range.end(), firstFrame);
+    QtConcurrent::blockingMap(range, [&project, &frames](int frameIndex){
+        frames[frameIndex] = project.frame(frameIndex);
+        if(frames[frameIndex].isNull()){
+            frames[frameIndex] = blankFrame(QSize(project.width(), project.height()));
+        }
+    });
+}
+
+/**
+ * @brief SpriteFile::readProject
+ * Reads every frame of a .ssp project
+ * @param fileName
+ * @param frames
+ * Replaced by the project's frames
+ * @param error
+ * Set to the reason if the project cannot be read
+ * @param durations
+ * If given, replaced by the milliseconds each frame is shown
+ * for, 0 for projects saved without timing
+ * @return
+ * true if the project was read
+ */
+bool SpriteFile::readProject(const QString &fileName, vector<QImage> &frames, QString &error,
+                             vector<int> *durations)
+{
+    std::unique_ptr<ProjectReader> project = openProject(fileName, error);
+    if(!project || !checkProjectSize(project->width(), project->height(), error)){
+        return false;
+    }
+    if(project->frameCount() == 0){
+        error = "Unable to open project: it has no frames";
+        return false;
+    }
+    frames.clear();
+    decodeFrames(*project, frames, 0);
+    if(durations){
+        *durations = project->frameDurations();
+    }
+    return true;
+}
+
+/**
+ * @brief SpriteFile::readImage
+ * Reads a png or jpg as a single frame
+ * @param fileName
+ * @param frameSize
+ * The image is scaled to this width and height, an invalid
+ * size keeps the image's own size as far as it is supported
+ * @param frames
+ * Replaced by the frame
+ * @param error
+ * Set to the reason if the image cannot be read
+ * @return
+ * true if the image was read
+ */
+bool SpriteFile::readImage(const QString &fileName, const QSize &frameSize, vector<QImage> &frames, QString &error)
+{
+    QImageReader reader(fileName);
+    QImage image = reader.read();
+    if(image.isNull()){
+        error = "Unable to open image: " + reader.errorString();
+        return false;
+    }
+    frames.clear();
+    frames.push_back(downsample(image, frameSize.isValid() ? frameSize : fittedSize(image.size())));
+    return true;
+}
+
+/**
+ * @brief SpriteFile::readGif
+ * Reads a GIF one frame at a time. Each frame is decoded once
+ * and shrunk to the sprite size straight away, so only one
+ * full size frame is held at any time. GIFs often repeat a
+ * frame to hold a pose, repeats share the first one's pixels.
+ * @param fileName
+ * @param frameSize
+ * Frames are scaled to this width and height, an invalid
+ * size keeps the GIF's own size as far as it is supported
+ * @param frames
+ * Replaced by the GIF's frames
+ * @param error
+ * Set to the reason if the GIF cannot be read
+ * @param durations
+ * If given, replaced by the milliseconds each frame is shown for
+ * @return
+ * true if at least one frame was read
+ */
+bool SpriteFile::readGif(const QString &fileName, const QSize &frameSize, vector<QImage> &frames,
+                         QString &error, vector<int> *durations)
+{
+    QImageReader reader(fileName, "gif");
+    if(!reader.canRead()){
+        error = "Invalid or unsupported GIF file.";
+        return false;
+    }
+    QSize size = frameSize;
+    if(!size.isValid()){
+        size = fittedSize(reader.size());
+    }
+    vector<QImage> gifFrames;
+    vector<int> gifDurations;
+    if(reader.imageCount() > 0){
+        gifFrames.reserve(reader.imageCount());
+        gifDurations.reserve(reader.imageCount());
+    }
+    QImage frame;
+    while(reader.canRead() && reader.read(&frame)){
+        if(!size.isValid()){
+            size = fittedSize(frame.size());
+        }
+        gifFrames.push_back(downsample(frame, size));
+        gifDurations.push_back(qMax(0, reader.nextImageDelay()));
+    }
+    if(gifFrames.empty()){
+        error = "Invalid or unsupported GIF file.";
+        return false;
+    }
+    shareDuplicateFrames(gifFrames);
+    frames.swap(gifFrames);
+    if(durations){
+        durations->swap(gifDurations);
+    }
+    return true;
+}
+
+/**
+ * @brief SpriteFile::read
+ * Reads a project, image or GIF chosen by the file extension
+ * @param fileName
+ * @param frameSize
+ * Size images and GIFs are scaled to, projects keep their own.
+ * An invalid size lets images and GIFs keep theirs too.
+ * @param frames
+ * Replaced by the frames read
+ * @param error
+ * Set to the reason if the file cannot be read
+ * @param durations
+ * If given, replaced by the milliseconds each frame is shown
+ * for, empty for images and 0 for projects without timing
+ * @return
+ * true if the file was read
+ */
+bool SpriteFile::read(const QString &fileName, const QSize &frameSize, vector<QImage> &frames,
+                      QString &error, vector<int> *durations)
+{
+    if(durations){
+        durations->clear();
+    }
+    QString ext = QFileInfo(fileName).suffix().toLower();
+    if(ext == "ssp"){
+        return readProject(fileName, frames, error, durations);
+    }
+    if(ext == "png" || ext == "jpg"){
+        return readImage(fileName, frameSize, frames, error);
+    }
+    if(ext == "gif"){
+        return readGif(fileName, frameSize, frames, error, durations);
+    }
+    error = "Selected file type is not supported.";
+    return false;
+}
+
+/**
+ * @brief SpriteFile::writeProject
+ * Writes the frames as a .ssp project, replacing the file
+ * only once it has been written completely
+ * @param fileName
+ * @param frames
+ * @param durations
+ * Milliseconds each frame is shown for, kept with the frames
+ * @param format
+ * Binary, or indented or compact JSON
+ * @param error
+ * Set to the reason if the project cannot be written
+ * @return
+ * true if the project was written
+ */
+bool SpriteFile::writeProject(const QString &fileName, const vector<QImage> &frames, const vector<int> &durations,
+                              ProjectFormat format, QString &error)
+{
+    bool written = false;
+    if(format == Binary){
+        written = BinaryProject::write(fileName, frames, durations);
+    }
+    else{
+        QSaveFile file(fileName);
+        written = file.open(QIODevice::WriteOnly)
+                && JsonProject::write(&file, frames, format == CompactJson, durations)
+                && file.commit();
+    }
+    if(!written){
+        error = "Unable to save the project to " + fileName;
+    }
+    return written;
+}
+
+/**
+ * @brief SpriteFile::countFrames
+ * Finds how many frames a file holds without decoding them, so
+ * the files a conversion will write are known up front
+ * @param fileName
+ * A project, image or GIF
+ * @param error
+ * Set to the reason if the file cannot be read
+ * @return
+ * The number of frames, 0 if the file cannot be read
+ */
+int SpriteFile::countFrames(const QString &fileName, QString &error)
+{
+    QString ext = QFileInfo(fileName).suffix().toLower();
+    if(ext == "ssp"){
+        std::unique_ptr<ProjectReader> project = openProject(fileName, error);
+        return project ? project->frameCount() : 0;
+    }
+    if(ext == "png" || ext == "jpg"){
+        return 1;
+    }
+    if(ext == "gif"){
+        QImageReader reader(fileName, "gif");
+        int count = reader.canRead() ? reader.imageCount() : 0;
+        if(count <= 0){
+            //not every GIF can be counted without reading it
+            count = 0;
+            QImage frame;
+            while(reader.canRead() && reader.read(&frame)){
+                count++;
+            }
+        }
+        if(count == 0){
+            error = "Invalid or unsupported GIF file.";
+        }
+        return count;
+    }
+    error = "Selected file type is not supported.";
+    return 0;
+}
+
+/**
+ * @brief SpriteFile::imagePaths
+ * @param fileName
+ * @param frameCount
+ * @return
+ * The files writeImages writes that many frames to. A single
+ * frame is written to the file name, more frames get their
+ * number added: walk.png becomes walk_000.png, walk_001.png
+ * and so on.
+ */
+QStringList SpriteFile::imagePaths(const QString &fileName, int frameCount)
+{
+    if(frameCount == 1){
+        return {fileName};
+    }
+    QFileInfo fileInfo(fileName);
+    QStringList paths;
+    for(int frameIndex = 0; frameIndex < frameCount; frameIndex++){
+        paths.append(fileInfo.path() + "/" + fileInfo.completeBaseName()
+                     + QString("_%1.").arg(frameIndex, 3, 10, QChar('0')) + fileInfo.suffix());
+    }
+    return paths;
+}
+
+/**
+ * @brief SpriteFile::writeImages
+ * Writes each frame as an image to the files imagePaths names,
+ * the format follows the file extension. Every frame is encoded
+ * before any file is touched, so a frame that cannot be encoded
+ * leaves no files written, and each file is replaced only once
+ * it has been written completely.
+ * @param fileName
+ * @param frames
+ * @param error
+ * Set to the reason if an image cannot be written
+ * @return
+ * true if every frame was written
+ */
+bool SpriteFile::writeImages(const QString &fileName, const vector<QImage> &frames, QString &error)
+{
+    const QStringList paths = imagePaths(fileName, frames.size());
+    const QByteArray format = QFileInfo(fileName).suffix().toLatin1();
+    vector<QByteArray> encoded(frames.size());
+    for(int frameIndex = 0; frameIndex < (int)frames.size(); frameIndex++){
+        QBuffer buffer(&encoded[frameIndex]);
+        if(!buffer.open(QIODevice::WriteOnly) || !frames[frameIndex].save(&buffer, format.constData())){
+            error = "Unable to write " + paths[frameIndex];
+            return false;
+        }
+    }
+    for(int frameIndex = 0; frameIndex < (int)frames.size(); frameIndex++){
+        QSaveFile file(paths[frameIndex]);
+        if(!file.open(QIODevice::WriteOnly) || file.write(encoded[frameIndex]) != encoded[frameIndex].size()
+                || !file.commit()){
+            error = "Unable to write " + paths[frameIndex];
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief SpriteFile::writeGif
+ * Writes the frames as an animated GIF that loops forever
+ * @param fileName
+ * @param frames
+ * @param durations
+ * Milliseconds per frame, a missing or 0 entry uses the default
+ * @param defaultDuration
+ * @param error
+ * Set to the reason if the GIF cannot be written
+ * @return
+ * true if the GIF was written
+ */
+bool SpriteFile::writeGif(const QString &fileName, const vector<QImage> &frames,
+                          const vector<int> &durations, int defaultDuration, QString &error)
+{
+    if(!GifWriter::write(fileName, frames, durations, defaultDuration)){
+        error = "Unable to export the GIF to " + fileName;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief SpriteFile::writeAtlas
+ * Packs the frames into one atlas image and writes its index
+ * next to it, walk.png gets walk.json or walk.atlas
+ * @param fileName
+ * The atlas image
+ * @param frames
+ * @param durations
+ * Milliseconds per frame, stored in the index
+ * @param options
+ * Packing, trimming and index format
+ * @param error
+ * Set to the reason if the atlas cannot be written
+ * @return
+ * true if the atlas and its index were written
+ */
+bool SpriteFile::writeAtlas(const QString &fileName, const vector<QImage> &frames, const vector<int> &durations,
+                            const AtlasWriter::Options &options, QString &error)
+{
+    QString indexName = AtlasWriter::indexFileName(fileName, options.indexFormat);
+    QString atlasError;
+    if(!AtlasWriter::write(fileName, indexName, frames, durations, options, atlasError)){
+        error = "Unable to export the atlas to " + fileName;
+        if(!atlasError.isEmpty()){
+            error += ": " + atlasError;
+        }
+        return false;
+    }
+    return true;
+}
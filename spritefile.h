@@ -0,0 +1,63 @@
+#ifndef SPRITEFILE_H
+#define SPRITEFILE_H
+
+#include "atlaswriter.h"
+#include "projectreader.h"
+#include <QImage>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <memory>
+#include <vector>
+
+using std::vector;
+
+/**
+ * Reading and writing sprites without any user interface.
+ *
+ * Everything here only needs QtCore, QtGui's image classes and
+ * QtConcurrent, so the editor and the spriteconv command line
+ * tool share it. Failures are returned with a message for the
+ * caller to show however it shows errors.
+ *
+ * Frames are QImages, which share their pixels until one of them
+ * is written to. Identical frames read from a file are made to
+ * share one buffer, so held poses cost nothing until edited.
+ */
+class SpriteFile
+{
+public:
+    enum ProjectFormat {
+        Binary,
+        Json,
+        CompactJson
+    };
+
+    static const int MAX_SIDE = 4096;
+
+    static QImage blankFrame(const QSize&);
+    static QImage downsample(const QImage&, const QSize&);
+    static QSize fittedSize(const QSize&);
+    static QSize parseSize(const QString&);
+    static bool isSupportedSize(const QSize&);
+    static bool checkProjectSize(int, int, QString&);
+    static int shareDuplicateFrames(vector<QImage>&);
+
+    static std::unique_ptr<ProjectReader> openProject(const QString&, QString&);
+    static void decodeFrames(const ProjectReader&, vector<QImage>&, int);
+    static void decodeFrameRange(const ProjectReader&, vector<QImage>&, int, int);
+    static bool readProject(const QString&, vector<QImage>&, QString&, vector<int>* = nullptr);
+    static bool readImage(const QString&, const QSize&, vector<QImage>&, QString&);
+    static bool readGif(const QString&, const QSize&, vector<QImage>&, QString&, vector<int>* = nullptr);
+    static bool read(const QString&, const QSize&, vector<QImage>&, QString&, vector<int>* = nullptr);
+    static int countFrames(const QString&, QString&);
+    static QStringList imagePaths(const QString&, int);
+
+    static bool writeProject(const QString&, const vector<QImage>&, const vector<int>&, ProjectFormat, QString&);
+    static bool writeImages(const QString&, const vector<QImage>&, QString&);
+    static bool writeGif(const QString&, const vector<QImage>&, const vector<int>&, int, QString&);
+    static bool writeAtlas(const QString&, const vector<QImage>&, const vector<int>&,
+                           const AtlasWriter::Options&, QString&);
+};
+
+#endif // SPRITEFILE_H
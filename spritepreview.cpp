@@ -6,7 +6,6 @@
  */
 #include "spritepreview.h"
 #include "ui_spritepreview.h"
-#include <QTimer>
 
 /**
  * @brief spritePreview::spritePreview
@@ -19,9 +18,8 @@ spritePreview::spritePreview(QWidget *parent) :
     ui(new Ui::spritePreview)
 {
     ui->setupUi(this);
-    previewFrame = 0;
-    frameDelay = 0;
-    previewActive = false;
+    modelPtr = nullptr;
+    previewFrame = -1;
 }
 
 /**
@@ -35,48 +33,79 @@ spritePreview::~spritePreview()
 
 /**
  * @brief spritePreview::setSpriteWidth
- * setup and show sprite window, initiate animation
+ * setup and show sprite window, the animation clock
+ * starts ticking it once it is visible. Sprites are shown
+ * at their real size, large ones are shrunk to fit
  * @param model
  * pointer of the model
- * @param delay
- * delay to use for animation
  */
-void spritePreview::setSpriteWidth(Model* model, int delay)
+void spritePreview::setSpriteWidth(Model* model)
 {
-    frameDelay = delay;
     modelPtr = model;
-    int width = DEFAULT_WIDTH / model->pixelWidth;
+    QSize shown = model->spriteSize;
+    if(shown.width() > 158 || shown.height() > 128){
+        shown = shown.scaled(158, 128, Qt::KeepAspectRatio);
+    }
 
-    ui->previewSprite->setGeometry( (158 - width)/2, (128 - width)/2 ,width ,width);
+    ui->previewSprite->setGeometry((158 - shown.width())/2, (128 - shown.height())/2,
+                                   shown.width(), shown.height());
     this->show();
-    previewActive = true;
-    previewAnimation();
 }
 
 /**
- * @brief spritePreview::previewAnimation
- * manage the animation of the sprite preview
+ * @brief spritePreview::playFrame
+ * Shows the frame the animation clock is on
+ * @param frameIndex
+ * Frame to show
  */
-void spritePreview::previewAnimation()
+void spritePreview::playFrame(int frameIndex)
 {
-    if(previewFrame >= (int)modelPtr->frames.size()){
-        previewFrame = 0;
+    if(!modelPtr || !isVisible() || frameIndex >= (int)modelPtr->frames.size()){
+        return;
+    }
+    if(frameIndex < previewFrame){
+        ui->previewSprite->trimCache(modelPtr->frames.size());
     }
+    previewFrame = frameIndex;
+    ui->previewSprite->playFrame(previewFrame, modelPtr->frames[previewFrame], modelPtr->palette, modelPtr->frameGeneration(previewFrame));
+}
 
-    ui->previewSprite->setPixmap(QPixmap::fromImage(modelPtr->frames[previewFrame++]));
-    if(previewActive){
-        QTimer::singleShot(frameDelay, this, &spritePreview::previewAnimation);
+/**
+ * @brief spritePreview::frameEdited
+ * Redraws the edited pixels if the preview is showing that frame
+ * @param frameIndex
+ * The frame that changed
+ * @param region
+ * The changed sprite pixels
+ */
+void spritePreview::frameEdited(int frameIndex, const QRect &region)
+{
+    if(isVisible() && modelPtr && frameIndex == previewFrame){
+        ui->previewSprite->showRegion(modelPtr->frames[frameIndex], modelPtr->palette, region);
     }
 }
 
 /**
- * @brief spritePreview::closeEvent
- * stop the preview animation before closing
+ * @brief spritePreview::showEvent
+ * Lets the animation clock know the preview needs ticks
+ * @param event
+ * show event
+ */
+void spritePreview::showEvent(QShowEvent *event)
+{
+    QWidget::showEvent(event);
+    emit visibilityChanged(true);
+}
+
+/**
+ * @brief spritePreview::hideEvent
+ * Lets the animation clock know the preview no longer needs ticks,
+ * closing the window hides it
  * @param event
- * close event
+ * hide event
  */
-void spritePreview::closeEvent(QCloseEvent *event)
+void spritePreview::hideEvent(QHideEvent *event)
 {
-    previewActive = false;
-    QWidget::closeEvent(event);
+    QWidget::hideEvent(event);
+    emit visibilityChanged(false);
 }
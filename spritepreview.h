@@ -17,15 +17,19 @@ public:
     ~spritePreview();
 
 public slots:
-    void setSpriteWidth(Model*, int);
+    void setSpriteWidth(Model*);
+    void playFrame(int);
+    void frameEdited(int, const QRect&);
+
+signals:
+    void visibilityChanged(bool);
 
 private:
     Model* modelPtr;
     Ui::spritePreview *ui;
-    int previewFrame, frameDelay;
-    bool previewActive;
-    void closeEvent(QCloseEvent *event);
-    void previewAnimation();
+    int previewFrame;
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
 };
 
 #endif // SPRITEPREVIEW_H
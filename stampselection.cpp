@@ -11,14 +11,18 @@
 /**
  * @brief StampSelection::StampSelection
  * This constructor sets up the window and titles it.
- * It then sets up the connections for all the buttons
- * in the window.
+ * It loads the stamp images and then sets up the
+ * connections for all the buttons in the window.
  * @param parent
  * Provides all the widget functionality
  */
 StampSelection::StampSelection(QWidget *parent) :
     QWidget{parent},
-    ui(new Ui::StampSelection)
+    ui(new Ui::StampSelection),
+    yellowSprite(":/Resources/stamp/Resources/stamp/yellowSprite.png"),
+    blueSprite(":/Resources/stamp/Resources/stamp/blueSprite.png"),
+    warriorSprite(":/Resources/stamp/Resources/stamp/warriorSprite.png"),
+    crabSprite(":/Resources/stamp/Resources/stamp/crabSprite.png")
 {
     ui->setupUi(this);
     this->setWindowTitle("Stamps");
@@ -45,12 +49,10 @@ StampSelection::~StampSelection()
 /**
  * @brief StampSelection::yellowSpriteChosen
  * When the yellow sprite stamp is chosen, this
- * loads the image informs the ui and model that a stamp has been selected
+ * informs the ui and model that a stamp has been selected
  */
 void StampSelection::yellowSpriteChosen()
 {
-    QImage yellowSprite(":/Resources/stamp/Resources/stamp/yellowSprite.png");
-
     emit stampSelected(true);
     emit setStamp(yellowSprite);
 }
@@ -58,12 +60,10 @@ void StampSelection::yellowSpriteChosen()
 /**
  * @brief StampSelection::blueSpriteChosen
  * When the blue sprite stamp is chosen, this
- * loads the image and informs the ui and model that a stamp has been selected
+ * informs the ui and model that a stamp has been selected
  */
 void StampSelection::blueSpriteChosen()
 {
-    QImage blueSprite(":/Resources/stamp/Resources/stamp/blueSprite.png");
-
     emit stampSelected(true);
     emit setStamp(blueSprite);
 }
@@ -71,12 +71,10 @@ void StampSelection::blueSpriteChosen()
 /**
  * @brief StampSelection::warriorSpriteChosen
  * When the warrior sprite stamp is chosen, this
- * loads the image and informs the ui and model that a stamp has been selected
+ * informs the ui and model that a stamp has been selected
  */
 void StampSelection::warriorSpriteChosen()
 {
-    QImage warriorSprite(":/Resources/stamp/Resources/stamp/warriorSprite.png");
-
     emit stampSelected(true);
     emit setStamp(warriorSprite);
 }
@@ -84,12 +82,10 @@ void StampSelection::warriorSpriteChosen()
 /**
  * @brief StampSelection::crabSpriteChosen
  * When the crab sprite stamp is chosen, this
- * loads the image and informs the ui and model that a stamp has been selected
+ * informs the ui and model that a stamp has been selected
  */
 void StampSelection::crabSpriteChosen()
 {
-    QImage crabSprite(":/Resources/stamp/Resources/stamp/crabSprite.png");
-
     emit stampSelected(true);
     emit setStamp(crabSprite);
 }
@@ -2,6 +2,7 @@
 #ifndef STAMPSELECTION_H
 #define STAMPSELECTION_H
 
+#include <QImage>
 #include <QWidget>
 
 namespace Ui {
@@ -17,6 +18,12 @@ public:
 
 private:
     Ui::StampSelection *ui;
+    //decoded once, every click sends a shallow copy so the model
+    //can keep its scaled stamp for the same image
+    QImage yellowSprite;
+    QImage blueSprite;
+    QImage warriorSprite;
+    QImage crabSprite;
 
     void yellowSpriteChosen();
     void blueSpriteChosen();
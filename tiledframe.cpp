@@ -0,0 +1,609 @@
+/**
+ * @brief Stores frames as tiles that share their pixels, so
+ * empty and unchanged parts of large sprites cost no memory.
+ */
+
+#include "tiledframe.h"
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
+#include <QtConcurrent>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+//values given a shared solid tile, later values get tiles of their own
+const int MAX_SOLID_TILES = 1024;
+
+/**
+ * The solid tiles every frame shares, by format and value, and
+ * their cache keys to tell a shared tile from an allocated one.
+ * Frames are filled and resized on worker threads too.
+ */
+struct SolidTiles {
+    QMutex mutex;
+    QHash<quint64, QImage> tiles;
+    QSet<qint64> keys;
+};
+
+static SolidTiles &solidTiles()
+{
+    static SolidTiles shared;
+    return shared;
+}
+
+/**
+ * @brief nextKey
+ * @return
+ * A cache key no frame has had yet
+ */
+static qint64 nextKey()
+{
+    static std::atomic<qint64> lastKey{0};
+    return ++lastKey;
+}
+
+static int bytesPerPixel(QImage::Format format)
+{
+    return format == QImage::Format_Indexed8 ? 1 : 4;
+}
+
+/**
+ * @brief valueAt
+ * @return
+ * The pixel's value, a palette index in indexed images
+ */
+static uint valueAt(const QImage &image, int x, int y)
+{
+    if(image.format() == QImage::Format_Indexed8){
+        return image.constScanLine(y)[x];
+    }
+    return reinterpret_cast<const QRgb*>(image.constScanLine(y))[x];
+}
+
+/**
+ * @brief holds
+ * @param image
+ * An ARGB32 or indexed image
+ * @param area
+ * Pixels of the image to check
+ * @param value
+ * @return
+ * true if every pixel of the area has the value
+ */
+static bool holds(const QImage &image, const QRect &area, uint value)
+{
+    for(int y = area.top(); y <= area.bottom(); y++){
+        if(image.format() == QImage::Format_Indexed8){
+            const uchar *line = image.constScanLine(y) + area.left();
+            if(std::any_of(line, line + area.width(), [value](uchar index){ return index != uchar(value); })){
+                return false;
+            }
+            continue;
+        }
+        const QRgb *line = reinterpret_cast<const QRgb*>(image.constScanLine(y)) + area.left();
+        if(std::any_of(line, line + area.width(), [value](QRgb pixel){ return pixel != QRgb(value); })){
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief fillTile
+ * Fills part of a tile one row at a time
+ * @param tile
+ * @param area
+ * Pixels of the tile to fill, may be empty
+ * @param value
+ */
+static void fillTile(QImage &tile, const QRect &area, uint value)
+{
+    if(area.isEmpty()){
+        return;
+    }
+    for(int y = area.top(); y <= area.bottom(); y++){
+        if(tile.format() == QImage::Format_Indexed8){
+            std::memset(tile.scanLine(y) + area.left(), int(value), area.width());
+        }
+        else{
+            std::fill_n(reinterpret_cast<QRgb*>(tile.scanLine(y)) + area.left(), area.width(), QRgb(value));
+        }
+    }
+}
+
+/**
+ * @brief TiledFrame::TiledFrame
+ * Creates a null frame
+ */
+TiledFrame::TiledFrame()
+    : d(new Data)
+{
+    d->key = nextKey();
+}
+
+/**
+ * @brief TiledFrame::TiledFrame
+ * Creates a frame of one value, which allocates no tiles
+ * @param size
+ * Width and height in sprite pixels
+ * @param format
+ * QImage::Format_ARGB32 or QImage::Format_Indexed8
+ * @param value
+ * The pixel, or its palette index in indexed frames
+ */
+TiledFrame::TiledFrame(const QSize &size, QImage::Format format, uint value)
+    : d(new Data)
+{
+    d->size = size;
+    d->format = format;
+    d->columns = (size.width() + TILE_SIZE - 1) / TILE_SIZE;
+    const int rows = (size.height() + TILE_SIZE - 1) / TILE_SIZE;
+    d->tiles.assign(size_t(d->columns) * rows, solidTile(format, value));
+    d->key = nextKey();
+}
+
+/**
+ * @brief TiledFrame::TiledFrame
+ * Splits an image into tiles. Only tiles holding more than one
+ * value are allocated, the rest share a solid tile.
+ * @param image
+ * Indexed images keep their indices, others are made ARGB32
+ */
+TiledFrame::TiledFrame(const QImage &image)
+    : d(new Data)
+{
+    d->key = nextKey();
+    if(image.isNull()){
+        return;
+    }
+    const QImage source = image.format() == QImage::Format_Indexed8 || image.format() == QImage::Format_ARGB32
+            ? image : image.convertToFormat(QImage::Format_ARGB32);
+    d->size = source.size();
+    d->format = source.format();
+    d->columns = (source.width() + TILE_SIZE - 1) / TILE_SIZE;
+    const int rows = (source.height() + TILE_SIZE - 1) / TILE_SIZE;
+    d->tiles.reserve(size_t(d->columns) * rows);
+    const int bytes = bytesPerPixel(d->format);
+    for(int y = 0; y < source.height(); y += TILE_SIZE){
+        for(int x = 0; x < source.width(); x += TILE_SIZE){
+            const QRect area = tileRect(QPoint(x, y));
+            const uint first = valueAt(source, x, y);
+            if(holds(source, area, first)){
+                d->tiles.push_back(solidTile(d->format, first));
+                continue;
+            }
+            QImage tile(TILE_SIZE, TILE_SIZE, d->format);
+            if(area.size() != tile.size()){
+                //pixels past the edge are never read, they are only
+                //set so tiles can be compared by their bytes
+                tile.fill(0);
+            }
+            for(int row = 0; row < area.height(); row++){
+                std::memcpy(tile.scanLine(row), source.constScanLine(y + row) + x * bytes, area.width() * bytes);
+            }
+            d->tiles.push_back(tile);
+        }
+    }
+}
+
+bool TiledFrame::isNull() const
+{
+    return d->size.isEmpty();
+}
+
+int TiledFrame::width() const
+{
+    return d->size.width();
+}
+
+int TiledFrame::height() const
+{
+    return d->size.height();
+}
+
+QSize TiledFrame::size() const
+{
+    return d->size;
+}
+
+QRect TiledFrame::rect() const
+{
+    return QRect(QPoint(0, 0), d->size);
+}
+
+QImage::Format TiledFrame::format() const
+{
+    return d->format;
+}
+
+/**
+ * @brief TiledFrame::cacheKey
+ * Like QImage::cacheKey, copies of a frame have the same key
+ * until one of them is written to
+ * @return
+ * A value that changes whenever the frame's pixels change
+ */
+qint64 TiledFrame::cacheKey() const
+{
+    return d->key;
+}
+
+/**
+ * @brief TiledFrame::sizeInBytes
+ * @return
+ * Pixel memory of the frame's own tiles, solid tiles are
+ * shared by every frame and not counted
+ */
+qint64 TiledFrame::sizeInBytes() const
+{
+    QSet<qint64> counted;
+    qint64 bytes = 0;
+    for(const QImage &tile : d->tiles){
+        if(counted.contains(tile.cacheKey())){
+            continue;
+        }
+        counted.insert(tile.cacheKey());
+        if(!isSolidTile(tile)){
+            bytes += tile.sizeInBytes();
+        }
+    }
+    return bytes;
+}
+
+void TiledFrame::swap(TiledFrame &other) noexcept
+{
+    d.swap(other.d);
+}
+
+/**
+ * @brief TiledFrame::tileRect
+ * @param pixel
+ * Any pixel of the tile
+ * @return
+ * The pixels of the frame the tile covers
+ */
+QRect TiledFrame::tileRect(QPoint pixel) const
+{
+    const QPoint origin(pixel.x() - pixel.x() % TILE_SIZE, pixel.y() - pixel.y() % TILE_SIZE);
+    return QRect(origin, QSize(TILE_SIZE, TILE_SIZE)).intersected(rect());
+}
+
+/**
+ * @brief TiledFrame::tile
+ * @param pixel
+ * Any pixel of the tile, inside the frame
+ * @return
+ * The tile, which shares its pixels with whoever keeps a copy
+ */
+const QImage &TiledFrame::tile(QPoint pixel) const
+{
+    return d->tiles[tileIndex(pixel.x(), pixel.y())];
+}
+
+/**
+ * @brief TiledFrame::setTile
+ * Puts back a tile the frame had before, nothing is copied
+ * @param pixel
+ * Any pixel of the tile
+ * @param tile
+ * A full size tile of the frame's format
+ */
+void TiledFrame::setTile(QPoint pixel, const QImage &tile)
+{
+    if(!rect().contains(pixel) || tile.size() != QSize(TILE_SIZE, TILE_SIZE) || tile.format() != format()){
+        return;
+    }
+    writableTile(tileIndex(pixel.x(), pixel.y())) = tile;
+}
+
+/**
+ * @brief TiledFrame::compactTile
+ * Swaps a tile that was drawn down to a single value, such as
+ * one erased back to transparent, for the shared solid tile.
+ * The pixels stay the same, so the cache key does too.
+ * @param pixel
+ * Any pixel of the tile
+ */
+void TiledFrame::compactTile(QPoint pixel)
+{
+    if(!rect().contains(pixel)){
+        return;
+    }
+    const int index = tileIndex(pixel.x(), pixel.y());
+    const QImage &tile = d.constData()->tiles[index];
+    if(isSolidTile(tile)){
+        return;
+    }
+    const QRect area = tileRect(pixel);
+    const uint value = valueAt(tile, 0, 0);
+    if(holds(tile, area.translated(-area.topLeft()), value)){
+        d->tiles[index] = solidTile(format(), value);
+    }
+}
+
+/**
+ * @brief TiledFrame::constScanLine
+ * @param x
+ * @param y
+ * A pixel inside the frame
+ * @return
+ * The pixel's place in its tile, the row goes on to the
+ * tile's right edge
+ */
+const uchar *TiledFrame::constScanLine(int x, int y) const
+{
+    return d->tiles[tileIndex(x, y)].constScanLine(y % TILE_SIZE) + (x % TILE_SIZE) * bytesPerPixel(format());
+}
+
+/**
+ * @brief TiledFrame::scanLine
+ * Like constScanLine but for writing, the tile stops sharing
+ * its pixels first
+ * @param x
+ * @param y
+ * A pixel inside the frame
+ * @return
+ * The pixel's place in its tile
+ */
+uchar *TiledFrame::scanLine(int x, int y)
+{
+    QImage &tile = writableTile(tileIndex(x, y));
+    return tile.scanLine(y % TILE_SIZE) + (x % TILE_SIZE) * bytesPerPixel(format());
+}
+
+/**
+ * @brief TiledFrame::fill
+ * Fills a rectangle with one value. Tiles it covers completely
+ * become the solid tile of the value, and tiles that already
+ * hold the value are left alone, so erasing empty space or
+ * clearing a frame allocates nothing.
+ * @param area
+ * The pixels to fill, parts outside the frame are ignored
+ * @param value
+ * The pixel, or its palette index in indexed frames
+ */
+void TiledFrame::fill(const QRect &area, uint value)
+{
+    const QRect clipped = area.intersected(rect());
+    if(clipped.isEmpty()){
+        return;
+    }
+    QImage solid;
+    for(int tileY = clipped.top() / TILE_SIZE; tileY <= clipped.bottom() / TILE_SIZE; tileY++){
+        for(int tileX = clipped.left() / TILE_SIZE; tileX <= clipped.right() / TILE_SIZE; tileX++){
+            const QPoint origin(tileX * TILE_SIZE, tileY * TILE_SIZE);
+            const QRect covered = tileRect(origin);
+            const QRect local = clipped.intersected(covered).translated(-origin);
+            const int index = tileIndex(origin.x(), origin.y());
+            if(holds(d.constData()->tiles[index], local, value)){
+                continue;
+            }
+            if(local.size() == covered.size()){
+                if(solid.isNull()){
+                    solid = solidTile(format(), value);
+                }
+                writableTile(index) = solid;
+                continue;
+            }
+            fillTile(writableTile(index), local, value);
+        }
+    }
+}
+
+/**
+ * @brief TiledFrame::resized
+ * Copies the frame into a frame of another size, oriented to the
+ * top left corner. Tiles that keep all the pixels they need are
+ * shared, only tiles that grow past the old edge are copied to
+ * be padded, and tiles wholly outside the old frame are padding.
+ * @param newSize
+ * Width and height of the new frame
+ * @param padding
+ * Value of the pixels past the old size
+ * @return
+ * The new frame
+ */
+TiledFrame TiledFrame::resized(const QSize &newSize, uint padding) const
+{
+    TiledFrame frame(newSize, format(), padding);
+    const int keptWidth = qMin(width(), newSize.width());
+    const int keptHeight = qMin(height(), newSize.height());
+    for(int y = 0; y < keptHeight; y += TILE_SIZE){
+        for(int x = 0; x < keptWidth; x += TILE_SIZE){
+            const QPoint origin(x, y);
+            const QRect kept = tileRect(origin).translated(-origin);
+            const QRect needed = frame.tileRect(origin).translated(-origin);
+            QImage &target = frame.d->tiles[frame.tileIndex(x, y)];
+            if(kept.contains(needed)){
+                target = tile(origin);
+                continue;
+            }
+            target = tile(origin).copy();
+            fillTile(target, QRect(kept.right() + 1, 0, needed.right() - kept.right(), needed.height()), padding);
+            fillTile(target, QRect(0, kept.bottom() + 1, needed.width(), needed.bottom() - kept.bottom()), padding);
+            frame.compactTile(origin);
+        }
+    }
+    return frame;
+}
+
+/**
+ * @brief TiledFrame::toImage
+ * @param colorTable
+ * The palette, given to indexed frames
+ * @return
+ * The whole frame as one image
+ */
+QImage TiledFrame::toImage(const QList<QRgb> &colorTable) const
+{
+    return toImage(rect(), colorTable);
+}
+
+/**
+ * @brief TiledFrame::toImage
+ * Copies part of the frame out of its tiles, one tile row at a time
+ * @param region
+ * The pixels to copy, clipped to the frame
+ * @param colorTable
+ * The palette, given to indexed frames
+ * @return
+ * The pixels as an image the size of the clipped region, null
+ * if there are none or the image could not be allocated
+ */
+QImage TiledFrame::toImage(const QRect &region, const QList<QRgb> &colorTable) const
+{
+    const QRect area = region.intersected(rect());
+    if(area.isEmpty()){
+        return QImage();
+    }
+    QImage image(area.size(), format());
+    if(image.isNull()){
+        return image;
+    }
+    const int bytes = bytesPerPixel(format());
+    for(int tileY = area.top() / TILE_SIZE; tileY <= area.bottom() / TILE_SIZE; tileY++){
+        for(int tileX = area.left() / TILE_SIZE; tileX <= area.right() / TILE_SIZE; tileX++){
+            const QPoint origin(tileX * TILE_SIZE, tileY * TILE_SIZE);
+            const QRect part = tileRect(origin).intersected(area);
+            const QImage &source = tile(origin);
+            for(int y = part.top(); y <= part.bottom(); y++){
+                std::memcpy(image.scanLine(y - area.top()) + (part.left() - area.left()) * bytes,
+                            source.constScanLine(y - origin.y()) + (part.left() - origin.x()) * bytes,
+                            part.width() * bytes);
+            }
+        }
+    }
+    if(format() == QImage::Format_Indexed8){
+        image.setColorTable(colorTable);
+    }
+    return image;
+}
+
+/**
+ * @brief TiledFrame::fromImages
+ * Splits images into frames in parallel. Images sharing their
+ * pixels are split once and the frames share their tiles.
+ * @param images
+ * @return
+ * The frames in the same order
+ */
+vector<TiledFrame> TiledFrame::fromImages(const vector<QImage> &images)
+{
+    vector<QImage> distinct;
+    vector<int> positions;
+    QHash<qint64, int> seen;
+    for(const QImage &image : images){
+        auto found = seen.constFind(image.cacheKey());
+        if(found == seen.cend()){
+            found = seen.insert(image.cacheKey(), distinct.size());
+            distinct.push_back(image);
+        }
+        positions.push_back(*found);
+    }
+    const vector<TiledFrame> split = QtConcurrent::blockingMapped<vector<TiledFrame>>(distinct,
+        [](const QImage &image){
+            return TiledFrame(image);
+        });
+    vector<TiledFrame> frames;
+    frames.reserve(images.size());
+    for(int position : positions){
+        frames.push_back(split[position]);
+    }
+    return frames;
+}
+
+/**
+ * @brief TiledFrame::toImages
+ * Makes frames into images in parallel, for the file code. Frames
+ * sharing their tiles become images sharing their pixels, which
+ * the project formats store once.
+ * @param frames
+ * @param colorTable
+ * The palette, given to indexed frames
+ * @return
+ * The images in the same order
+ */
+vector<QImage> TiledFrame::toImages(const vector<TiledFrame> &frames, const QList<QRgb> &colorTable)
+{
+    vector<TiledFrame> distinct;
+    vector<int> positions;
+    QHash<qint64, int> seen;
+    for(const TiledFrame &frame : frames){
+        auto found = seen.constFind(frame.cacheKey());
+        if(found == seen.cend()){
+            found = seen.insert(frame.cacheKey(), distinct.size());
+            distinct.push_back(frame);
+        }
+        positions.push_back(*found);
+    }
+    const vector<QImage> joined = QtConcurrent::blockingMapped<vector<QImage>>(distinct,
+        [&colorTable](const TiledFrame &frame){
+            return frame.toImage(colorTable);
+        });
+    vector<QImage> images;
+    images.reserve(frames.size());
+    for(int position : positions){
+        images.push_back(joined[position]);
+    }
+    return images;
+}
+
+/**
+ * @brief TiledFrame::solidTile
+ * @param format
+ * @param value
+ * @return
+ * The tile of one value that every frame shares, or a tile of
+ * its own once too many values have one
+ */
+QImage TiledFrame::solidTile(QImage::Format format, uint value)
+{
+    const quint64 key = (quint64(format) << 32) | value;
+    SolidTiles &shared = solidTiles();
+    QMutexLocker locker(&shared.mutex);
+    auto found = shared.tiles.constFind(key);
+    if(found != shared.tiles.cend()){
+        return *found;
+    }
+    QImage tile(TILE_SIZE, TILE_SIZE, format);
+    tile.fill(value);
+    if(shared.tiles.size() < MAX_SOLID_TILES){
+        shared.tiles.insert(key, tile);
+        shared.keys.insert(tile.cacheKey());
+    }
+    return tile;
+}
+
+/**
+ * @brief TiledFrame::isSolidTile
+ * @param tile
+ * @return
+ * true if the tile is a shared solid tile, which costs a
+ * frame no memory of its own
+ */
+bool TiledFrame::isSolidTile(const QImage &tile)
+{
+    SolidTiles &shared = solidTiles();
+    QMutexLocker locker(&shared.mutex);
+    return shared.keys.contains(tile.cacheKey());
+}
+
+int TiledFrame::tileIndex(int x, int y) const
+{
+    return (y / TILE_SIZE) * d->columns + x / TILE_SIZE;
+}
+
+/**
+ * @brief TiledFrame::writableTile
+ * @param index
+ * @return
+ * The tile, about to be written to or replaced, so the frame
+ * gets a new cache key
+ */
+QImage &TiledFrame::writableTile(int index)
+{
+    d->key = nextKey();
+    return d->tiles[index];
+}
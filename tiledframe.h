@@ -0,0 +1,98 @@
+#ifndef TILEDFRAME_H
+#define TILEDFRAME_H
+
+#include <QImage>
+#include <QList>
+#include <QPoint>
+#include <QRect>
+#include <QSharedData>
+#include <QSharedDataPointer>
+#include <QSize>
+#include <vector>
+
+using std::vector;
+
+/**
+ * A frame stored as square tiles rather than one image.
+ *
+ * Tiles are QImages and share their pixels like any other, so
+ * copying a frame or keeping its tiles for undo copies nothing
+ * until a tile is drawn on. A tile holding one value throughout,
+ * like the empty tiles of a large mostly transparent sprite, is
+ * not allocated per frame: every such tile points at one shared
+ * solid tile of that value. Tiles on the right and bottom edges
+ * are full size, their pixels past the frame are never read.
+ *
+ * Frames hold ARGB32 pixels or Indexed8 palette indices. Indexed
+ * tiles carry no color table, the palette is given when a frame
+ * is made into an image to be drawn or written out.
+ */
+class TiledFrame
+{
+public:
+    static const int TILE_SIZE = 32;
+
+    TiledFrame();
+    TiledFrame(const QSize&, QImage::Format, uint);
+    explicit TiledFrame(const QImage&);
+
+    bool isNull() const;
+    int width() const;
+    int height() const;
+    QSize size() const;
+    QRect rect() const;
+    QImage::Format format() const;
+    qint64 cacheKey() const;
+    qint64 sizeInBytes() const;
+    void swap(TiledFrame&) noexcept;
+
+    QRect tileRect(QPoint) const;
+    const QImage &tile(QPoint) const;
+    void setTile(QPoint, const QImage&);
+    void compactTile(QPoint);
+
+    template<typename Pixel>
+    Pixel pixel(int, int) const;
+    const uchar *constScanLine(int, int) const;
+    uchar *scanLine(int, int);
+    void fill(const QRect&, uint);
+    TiledFrame resized(const QSize&, uint) const;
+    QImage toImage(const QList<QRgb>& = QList<QRgb>()) const;
+    QImage toImage(const QRect&, const QList<QRgb>&) const;
+
+    static vector<TiledFrame> fromImages(const vector<QImage>&);
+    static vector<QImage> toImages(const vector<TiledFrame>&, const QList<QRgb>&);
+    static QImage solidTile(QImage::Format, uint);
+    static bool isSolidTile(const QImage&);
+
+private:
+    struct Data : public QSharedData {
+        QSize size;
+        QImage::Format format = QImage::Format_ARGB32;
+        int columns = 0;
+        vector<QImage> tiles;
+        qint64 key = 0;
+    };
+
+    QSharedDataPointer<Data> d;
+
+    int tileIndex(int, int) const;
+    QImage &writableTile(int);
+};
+
+/**
+ * @brief TiledFrame::pixel
+ * @param x
+ * @param y
+ * A pixel inside the frame
+ * @return
+ * The pixel's value, a palette index in indexed frames
+ */
+template<typename Pixel>
+inline Pixel TiledFrame::pixel(int x, int y) const
+{
+    const QImage &tile = d->tiles[tileIndex(x, y)];
+    return reinterpret_cast<const Pixel*>(tile.constScanLine(y % TILE_SIZE))[x % TILE_SIZE];
+}
+
+#endif // TILEDFRAME_H
@@ -0,0 +1,560 @@
+/**
+ * @brief Records edits to the frames as tile level deltas
+ * so they can be undone and redone without keeping full
+ * copies of every frame.
+ */
+
+#include "undohistory.h"
+#include "journal.h"
+#include <algorithm>
+#include <cstring>
+
+/**
+ * @brief UndoHistory::UndoHistory
+ * @param frames
+ * The frames the history records and restores
+ * @param durations
+ * Display time of each frame, kept in step with the frames
+ * @param palette
+ * Colors of indexed frames, empty when frames are ARGB
+ * @param budget
+ * Bytes of pixel data the history may hold before
+ * the oldest groups are dropped
+ */
+UndoHistory::UndoHistory(vector<TiledFrame> &frames, vector<int> &durations, QList<QRgb> &palette, qint64 budget)
+    : frames(frames), durations(durations), palette(palette), budget(budget)
+{
+
+}
+
+/**
+ * @brief UndoHistory::setJournal
+ * @param autosave
+ * Journal that is told about every change to the frames, and
+ * takes a snapshot whenever the history is cleared
+ */
+void UndoHistory::setJournal(Journal *autosave)
+{
+    journal = autosave;
+}
+
+/**
+ * @brief UndoHistory::beginGroup
+ * Starts a group of edits that is undone as one action.
+ * Groups nest, only the outermost endGroup closes it.
+ */
+void UndoHistory::beginGroup()
+{
+    depth++;
+}
+
+/**
+ * @brief UndoHistory::endGroup
+ * Closes the group. Tiles that ended up unchanged are dropped
+ * and an empty group is not added to the history.
+ */
+void UndoHistory::endGroup()
+{
+    if(depth == 0){
+        return;
+    }
+    depth--;
+    if(depth > 0){
+        return;
+    }
+    finishTiles();
+
+    Group group;
+    for(Step &step : openGroup.steps){
+        if(step.kind == Tile && samePixels(step.before, step.after)){
+            continue;
+        }
+        group.bytes += stepBytes(step);
+        group.steps.push_back(std::move(step));
+    }
+    openGroup.steps.clear();
+    if(group.steps.empty()){
+        return;
+    }
+
+    clearRedo();
+    usedBytes += group.bytes;
+    undoStack.push_back(std::move(group));
+    if(journal){
+        journal->recordSteps(undoStack.back().steps, false);
+    }
+    trimToBudget();
+}
+
+/**
+ * @brief UndoHistory::recordTiles
+ * Must be called before pixels of the region are changed.
+ * Keeps every tile the region touches that this group has not
+ * kept yet. Nothing is copied, the frame copies a tile when it
+ * is drawn on because the history still shares it. The new
+ * tiles are kept when the group ends.
+ * @param frameIndex
+ * Frame about to be changed
+ * @param region
+ * Pixels about to be changed
+ */
+void UndoHistory::recordTiles(int frameIndex, const QRect &region)
+{
+    if(depth == 0 || frameIndex < 0 || frameIndex >= static_cast<int>(frames.size())){
+        return;
+    }
+    const TiledFrame &frame = frames[frameIndex];
+    const QRect area = region.intersected(frame.rect());
+    if(area.isEmpty()){
+        return;
+    }
+
+    const int tileSize = TiledFrame::TILE_SIZE;
+    for(int tileY = area.top() / tileSize; tileY <= area.bottom() / tileSize; tileY++){
+        for(int tileX = area.left() / tileSize; tileX <= area.right() / tileSize; tileX++){
+            quint64 key = (quint64(frameIndex) << 32) | (quint64(tileY) << 16) | quint64(tileX);
+            if(pendingTiles.contains(key)){
+                continue;
+            }
+            Step step;
+            step.kind = Tile;
+            step.frame = frameIndex;
+            step.area = frame.tileRect(QPoint(tileX * tileSize, tileY * tileSize));
+            step.before = frame.tile(step.area.topLeft());
+            pendingTiles.insert(key, openGroup.steps.size());
+            openGroup.steps.push_back(step);
+        }
+    }
+}
+
+/**
+ * @brief UndoHistory::recordInsert
+ * Records that a frame was inserted, its duration must
+ * already be inserted too
+ * @param index
+ * Position the frame was inserted at
+ * @param frame
+ * The inserted frame
+ */
+void UndoHistory::recordInsert(int index, const TiledFrame &frame)
+{
+    if(depth == 0){
+        return;
+    }
+    finishTiles();
+    Step step;
+    step.kind = InsertFrame;
+    step.frame = index;
+    step.frameAfter = frame;
+    step.durationAfter = durations.at(index);
+    openGroup.steps.push_back(step);
+}
+
+/**
+ * @brief UndoHistory::recordRemove
+ * Records that a frame and its duration are being removed
+ * @param index
+ * Position of the removed frame
+ * @param frame
+ * The removed frame
+ */
+void UndoHistory::recordRemove(int index, const TiledFrame &frame)
+{
+    if(depth == 0){
+        return;
+    }
+    finishTiles();
+    Step step;
+    step.kind = RemoveFrame;
+    step.frame = index;
+    step.frameBefore = frame;
+    step.durationBefore = durations.at(index);
+    openGroup.steps.push_back(step);
+}
+
+/**
+ * @brief UndoHistory::recordMove
+ * Records that a frame is about to be moved to another
+ * position, only the positions are kept
+ * @param from
+ * Position of the frame before the move
+ * @param to
+ * Position of the frame after the move
+ */
+void UndoHistory::recordMove(int from, int to)
+{
+    if(depth == 0 || from == to){
+        return;
+    }
+    finishTiles();
+    Step step;
+    step.kind = MoveFrame;
+    step.frame = from;
+    step.frameTo = to;
+    openGroup.steps.push_back(step);
+}
+
+/**
+ * @brief UndoHistory::recordReplace
+ * Records that a whole frame was swapped for another image
+ * @param index
+ * Position of the frame
+ * @param before
+ * The frame before the change
+ * @param after
+ * The frame after the change
+ */
+void UndoHistory::recordReplace(int index, const TiledFrame &before, const TiledFrame &after)
+{
+    if(depth == 0){
+        return;
+    }
+    finishTiles();
+    Step step;
+    step.kind = ReplaceFrame;
+    step.frame = index;
+    step.frameBefore = before;
+    step.frameAfter = after;
+    openGroup.steps.push_back(step);
+}
+
+/**
+ * @brief UndoHistory::recordSpriteSize
+ * Records a change of the sprite size
+ * @param before
+ * Size in sprite pixels before the change
+ * @param after
+ * Size in sprite pixels after the change
+ */
+void UndoHistory::recordSpriteSize(const QSize &before, const QSize &after)
+{
+    if(depth == 0){
+        return;
+    }
+    Step step;
+    step.kind = SpriteSize;
+    step.sizeBefore = before;
+    step.sizeAfter = after;
+    openGroup.steps.push_back(step);
+}
+
+/**
+ * @brief UndoHistory::recordDuration
+ * Records a change of how long a frame is shown
+ * @param index
+ * Position of the frame
+ * @param before
+ * Milliseconds before the change
+ * @param after
+ * Milliseconds after the change
+ */
+void UndoHistory::recordDuration(int index, int before, int after)
+{
+    if(depth == 0 || before == after){
+        return;
+    }
+    Step step;
+    step.kind = FrameDuration;
+    step.frame = index;
+    step.durationBefore = before;
+    step.durationAfter = after;
+    openGroup.steps.push_back(step);
+}
+
+/**
+ * @brief UndoHistory::recordPalette
+ * Records a change of the indexed color palette. Only the color
+ * lists are kept, the frames' indices are not touched by it.
+ * @param before
+ * Palette before the change
+ * @param after
+ * Palette after the change
+ */
+void UndoHistory::recordPalette(const QList<QRgb> &before, const QList<QRgb> &after)
+{
+    if(depth == 0 || before == after){
+        return;
+    }
+    Step step;
+    step.kind = Palette;
+    step.paletteBefore = before;
+    step.paletteAfter = after;
+    openGroup.steps.push_back(step);
+}
+
+/**
+ * @brief UndoHistory::clear
+ * Forgets every recorded edit, used when a project is
+ * replaced by a new or loaded one
+ */
+void UndoHistory::clear()
+{
+    openGroup.steps.clear();
+    pendingTiles.clear();
+    undoStack.clear();
+    redoStack.clear();
+    usedBytes = 0;
+    //the journal starts over from the replaced project
+    if(journal){
+        journal->snapshot();
+    }
+}
+
+bool UndoHistory::canUndo() const
+{
+    return !undoStack.empty();
+}
+
+bool UndoHistory::canRedo() const
+{
+    return !redoStack.empty();
+}
+
+/**
+ * @brief UndoHistory::undo
+ * Reverts the most recent group, last step first
+ * @param spriteSize
+ * Set to the old size if the group resized the sprite
+ * @return
+ * true if there was something to undo
+ */
+bool UndoHistory::undo(QSize &spriteSize)
+{
+    if(undoStack.empty() || depth > 0){
+        return false;
+    }
+    Group group = std::move(undoStack.back());
+    undoStack.pop_back();
+
+    for(auto step = group.steps.rbegin(); step != group.steps.rend(); step++){
+        switch(step->kind){
+        case Tile:
+            frames[step->frame].setTile(step->area.topLeft(), step->before);
+            break;
+        case InsertFrame:
+            frames.erase(frames.begin() + step->frame);
+            durations.erase(durations.begin() + step->frame);
+            break;
+        case RemoveFrame:
+            frames.insert(frames.begin() + step->frame, step->frameBefore);
+            durations.insert(durations.begin() + step->frame, step->durationBefore);
+            break;
+        case MoveFrame:
+            moveFrame(step->frameTo, step->frame);
+            break;
+        case ReplaceFrame:
+            frames[step->frame] = step->frameBefore;
+            break;
+        case SpriteSize:
+            spriteSize = step->sizeBefore;
+            break;
+        case FrameDuration:
+            durations[step->frame] = step->durationBefore;
+            break;
+        case Palette:
+            applyPalette(step->paletteBefore);
+            break;
+        }
+    }
+    if(journal){
+        journal->recordSteps(group.steps, true);
+    }
+    redoStack.push_back(std::move(group));
+    return true;
+}
+
+/**
+ * @brief UndoHistory::redo
+ * Applies the most recently undone group again
+ * @param spriteSize
+ * Set to the new size if the group resized the sprite
+ * @return
+ * true if there was something to redo
+ */
+bool UndoHistory::redo(QSize &spriteSize)
+{
+    if(redoStack.empty() || depth > 0){
+        return false;
+    }
+    Group group = std::move(redoStack.back());
+    redoStack.pop_back();
+
+    for(const Step &step : group.steps){
+        switch(step.kind){
+        case Tile:
+            frames[step.frame].setTile(step.area.topLeft(), step.after);
+            break;
+        case InsertFrame:
+            frames.insert(frames.begin() + step.frame, step.frameAfter);
+            durations.insert(durations.begin() + step.frame, step.durationAfter);
+            break;
+        case RemoveFrame:
+            frames.erase(frames.begin() + step.frame);
+            durations.erase(durations.begin() + step.frame);
+            break;
+        case MoveFrame:
+            moveFrame(step.frame, step.frameTo);
+            break;
+        case ReplaceFrame:
+            frames[step.frame] = step.frameAfter;
+            break;
+        case SpriteSize:
+            spriteSize = step.sizeAfter;
+            break;
+        case FrameDuration:
+            durations[step.frame] = step.durationAfter;
+            break;
+        case Palette:
+            applyPalette(step.paletteAfter);
+            break;
+        }
+    }
+    if(journal){
+        journal->recordSteps(group.steps, false);
+    }
+    undoStack.push_back(std::move(group));
+    return true;
+}
+
+/**
+ * @brief UndoHistory::finishTiles
+ * Keeps the current tile of every tile recorded so far. Tiles
+ * drawn down to one value, like ones erased back to transparent,
+ * become the shared solid tile again first. Done at the end of
+ * the group and before a frame is added or removed, since that
+ * moves the frames the tiles belong to.
+ */
+void UndoHistory::finishTiles()
+{
+    for(size_t stepIndex : pendingTiles){
+        Step &step = openGroup.steps[stepIndex];
+        if(step.frame >= static_cast<int>(frames.size())
+                || frames[step.frame].tileRect(step.area.topLeft()) != step.area){
+            step.after = step.before;
+            continue;
+        }
+        TiledFrame &frame = frames[step.frame];
+        frame.compactTile(step.area.topLeft());
+        step.after = frame.tile(step.area.topLeft());
+    }
+    pendingTiles.clear();
+}
+
+/**
+ * @brief UndoHistory::clearRedo
+ * A new edit makes the undone groups unreachable
+ */
+void UndoHistory::clearRedo()
+{
+    for(const Group &group : redoStack){
+        usedBytes -= group.bytes;
+    }
+    redoStack.clear();
+}
+
+/**
+ * @brief UndoHistory::trimToBudget
+ * Drops the oldest groups until the history fits the budget,
+ * always keeping the latest one
+ */
+void UndoHistory::trimToBudget()
+{
+    while(usedBytes > budget && undoStack.size() > 1){
+        usedBytes -= undoStack.front().bytes;
+        undoStack.pop_front();
+    }
+}
+
+/**
+ * @brief UndoHistory::applyPalette
+ * Sets the palette. Frames only hold indices into it, so
+ * nothing else changes.
+ * @param colors
+ */
+void UndoHistory::applyPalette(const QList<QRgb> &colors)
+{
+    palette = colors;
+}
+
+/**
+ * @brief UndoHistory::moveFrame
+ * Moves a frame and its duration to another position
+ * @param from
+ * @param to
+ */
+void UndoHistory::moveFrame(int from, int to)
+{
+    if(from < to){
+        std::rotate(frames.begin() + from, frames.begin() + from + 1, frames.begin() + to + 1);
+        std::rotate(durations.begin() + from, durations.begin() + from + 1, durations.begin() + to + 1);
+    }
+    else{
+        std::rotate(frames.begin() + to, frames.begin() + from, frames.begin() + from + 1);
+        std::rotate(durations.begin() + to, durations.begin() + from, durations.begin() + from + 1);
+    }
+}
+
+/**
+ * @brief UndoHistory::blit
+ * Copies a tile back into an image row by row, used to replay
+ * journaled tiles on the frames of a recovered project
+ * @param frame
+ * @param tile
+ * @param origin
+ * Top left corner of the tile in the frame
+ */
+void UndoHistory::blit(QImage &frame, const QImage &tile, QPoint origin)
+{
+    if(tile.isNull() || tile.format() != frame.format()
+            || !frame.rect().contains(QRect(origin, tile.size()))){
+        return;
+    }
+    const int bytesPerPixel = tile.depth() / 8;
+    for(int y = 0; y < tile.height(); y++){
+        std::memcpy(frame.scanLine(origin.y() + y) + origin.x() * bytesPerPixel,
+                    tile.constScanLine(y), tile.width() * bytesPerPixel);
+    }
+}
+
+/**
+ * @brief UndoHistory::samePixels
+ * Compares tiles by their stored bytes. Indexed tiles carry no
+ * color table, QImage's own comparison would need one.
+ * @param first
+ * @param second
+ * @return
+ * true if both tiles hold the same pixel values
+ */
+bool UndoHistory::samePixels(const QImage &first, const QImage &second)
+{
+    //a tile that was never drawn on is still the same image
+    if(first.cacheKey() == second.cacheKey()){
+        return true;
+    }
+    if(first.size() != second.size() || first.format() != second.format()){
+        return false;
+    }
+    const size_t rowBytes = size_t(first.width()) * first.depth() / 8;
+    for(int y = 0; y < first.height(); y++){
+        if(std::memcmp(first.constScanLine(y), second.constScanLine(y), rowBytes) != 0){
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief UndoHistory::stepBytes
+ * @return
+ * Pixel memory held by one step, shared solid tiles cost nothing
+ */
+qint64 UndoHistory::stepBytes(const Step &step)
+{
+    qint64 bytes = step.frameBefore.sizeInBytes() + step.frameAfter.sizeInBytes();
+    for(const QImage *tile : {&step.before, &step.after}){
+        if(!TiledFrame::isSolidTile(*tile)){
+            bytes += tile->sizeInBytes();
+        }
+    }
+    return bytes;
+}
@@ -0,0 +1,113 @@
+#ifndef UNDOHISTORY_H
+#define UNDOHISTORY_H
+
+#include "tiledframe.h"
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QPoint>
+#include <QRect>
+#include <QSize>
+#include <deque>
+#include <vector>
+
+using std::vector;
+
+class Journal;
+
+/**
+ * Undo and redo for the model's frames.
+ *
+ * Edits are recorded in groups, one group per user action
+ * (a whole pencil stroke, a fill, a frame insert, a resize).
+ * Pixel edits only keep the frame tiles they touched, as they
+ * were before the first change and when the group ends. Tiles
+ * share their pixels with the frame until it is drawn on and
+ * empty tiles are shared by every frame, so undoing costs as
+ * much as the pixels that changed. Groups nest, and the oldest
+ * groups are dropped once the memory budget is used.
+ * Every group that is committed, undone or redone is also handed
+ * to the autosave journal when there is one.
+ */
+class UndoHistory
+{
+public:
+    enum StepKind {
+        Tile,
+        InsertFrame,
+        RemoveFrame,
+        MoveFrame,
+        ReplaceFrame,
+        SpriteSize,
+        FrameDuration,
+        Palette
+    };
+
+    struct Step {
+        StepKind kind = Tile;
+        int frame = -1;
+        int frameTo = -1;
+        QRect area;
+        QImage before;
+        QImage after;
+        TiledFrame frameBefore;
+        TiledFrame frameAfter;
+        QSize sizeBefore;
+        QSize sizeAfter;
+        int durationBefore = 0;
+        int durationAfter = 0;
+        QList<QRgb> paletteBefore;
+        QList<QRgb> paletteAfter;
+    };
+
+    UndoHistory(vector<TiledFrame> &frames, vector<int> &durations, QList<QRgb> &palette, qint64 budget);
+
+    void setJournal(Journal*);
+
+    void beginGroup();
+    void endGroup();
+    void recordTiles(int, const QRect&);
+    void recordInsert(int, const TiledFrame&);
+    void recordRemove(int, const TiledFrame&);
+    void recordMove(int, int);
+    void recordReplace(int, const TiledFrame&, const TiledFrame&);
+    void recordSpriteSize(const QSize&, const QSize&);
+    void recordDuration(int, int, int);
+    void recordPalette(const QList<QRgb>&, const QList<QRgb>&);
+    void clear();
+
+    bool canUndo() const;
+    bool canRedo() const;
+    bool undo(QSize&);
+    bool redo(QSize&);
+
+    static void blit(QImage&, const QImage&, QPoint);
+
+private:
+    struct Group {
+        vector<Step> steps;
+        qint64 bytes = 0;
+    };
+
+    vector<TiledFrame> &frames;
+    vector<int> &durations;
+    QList<QRgb> &palette;
+    qint64 budget;
+    Journal *journal = nullptr;
+    qint64 usedBytes = 0;
+    int depth = 0;
+    Group openGroup;
+    QHash<quint64, size_t> pendingTiles;
+    std::deque<Group> undoStack;
+    std::deque<Group> redoStack;
+
+    void finishTiles();
+    void clearRedo();
+    void trimToBudget();
+    void applyPalette(const QList<QRgb>&);
+    void moveFrame(int, int);
+    static qint64 stepBytes(const Step&);
+    static bool samePixels(const QImage&, const QImage&);
+};
+
+#endif // UNDOHISTORY_H